@@ -0,0 +1,219 @@
+//========================================================//
+//  alias.c                                               //
+//  Source file for the table aliasing analyser           //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include "alias.h"
+#include "counter.h"
+
+static inline uint32_t
+private_hash(uint32_t pc, uint32_t index, int table)
+{
+  uint32_t h = (pc * 0x9E3779B1u) ^ (index * 0x85EBCA6Bu) ^ (uint32_t)table;
+  return h ^ (h >> 16);
+}
+
+// Find the slot for ('table', 'index', 'pc'), possibly empty,
+// by linear probing
+//
+static inline alias_private *
+private_slot(alias_private *slots, uint32_t mask, uint32_t pc, uint32_t index, int table)
+{
+  uint32_t i = private_hash(pc, index, table) & mask;
+  while (slots[i].table && (slots[i].table != table + 1 || slots[i].pc != pc ||
+                            slots[i].index != index)) {
+    i = (i + 1) & mask;
+  }
+  return &slots[i];
+}
+
+// Double the private counters once they are half full
+//
+static void
+private_grow(alias_analysis *s)
+{
+  uint32_t size = (s->mask + 1) * 2;
+  alias_private *slots = (alias_private*)calloc(size, sizeof(alias_private));
+
+  for (uint32_t i = 0; i <= s->mask; i++) {
+    const alias_private *p = &s->priv[i];
+    if (p->table) {
+      *private_slot(slots, size - 1, p->pc, p->index, p->table - 1) = *p;
+    }
+  }
+
+  free(s->priv);
+  s->priv = slots;
+  s->mask = size - 1;
+}
+
+alias_analysis *
+alias_create(const bp_access *a, int n)
+{
+  if (n == 0) {
+    fprintf(stderr, "Aliasing analysis covers gshare and tournament only\n");
+    return NULL;
+  }
+  for (int t = 0; t < n; t++) {
+    if (a[t].entries > (1u << ALIAS_MAX_BITS)) {
+      fprintf(stderr, "Aliasing analysis covers tables of up to 2^%d entries, %s has %u\n",
+              ALIAS_MAX_BITS, a[t].table, a[t].entries);
+      return NULL;
+    }
+  }
+
+  alias_analysis *s = (alias_analysis*)calloc(1, sizeof(alias_analysis));
+  s->ntables = n;
+  for (int t = 0; t < n; t++) {
+    s->tables[t].name = a[t].table;
+    s->tables[t].entries = a[t].entries;
+    s->tables[t].counter = a[t].counter;
+    s->tables[t].shadow = (alias_entry*)calloc(a[t].entries, sizeof(alias_entry));
+  }
+  s->mask = ALIAS_INITIAL_PRIVATE - 1;
+  s->priv = (alias_private*)calloc(ALIAS_INITIAL_PRIVATE, sizeof(alias_private));
+  return s;
+}
+
+void
+alias_record(alias_analysis *s, uint32_t pc, uint8_t outcome,
+             const bp_access *a, int n)
+{
+  s->branches++;
+  for (int t = 0; t < n; t++) {
+    alias_table *tab = &s->tables[t];
+    alias_entry *e = &tab->shadow[a[t].index];
+    int aliased = e->accesses && e->last_pc != pc;
+    tab->accesses++;
+    tab->aliased += aliased;
+    e->accesses++;
+    e->aliased += aliased;
+    e->last_pc = pc;
+    if (!tab->counter) {
+      continue;
+    }
+
+    // The private counter starts where the table's did and is
+    // trained on every access, aliased or not
+    alias_private *p = private_slot(s->priv, s->mask, pc, a[t].index, t);
+    if (!p->table) {
+      p->pc = pc;
+      p->index = a[t].index;
+      p->table = t + 1;
+      p->state = WN;
+      if (++s->used * 2 > s->mask + 1) {
+        private_grow(s);
+        p = private_slot(s->priv, s->mask, pc, a[t].index, t);
+      }
+    }
+    uint8_t shared = ctr_taken(a[t].state, 2);
+    uint8_t own = ctr_taken(p->state, 2);
+    if (aliased && shared != own) {
+      int constructive = shared == outcome;
+      tab->constructive += constructive;
+      tab->destructive += !constructive;
+      e->constructive += constructive;
+      e->destructive += !constructive;
+    }
+    p->state = ctr_update(p->state, outcome, 2);
+  }
+}
+
+static int
+log2_bucket(uint32_t v)
+{
+  return 32 - __builtin_clz(v);
+}
+
+// Print the entries of 't' grouped by log2 of their accesses,
+// with each group's share of the accesses and aliasing
+//
+static void
+report_histogram(const alias_table *t, FILE *out)
+{
+  uint64_t entries[ALIAS_HOT_BUCKETS] = { 0 };
+  uint64_t accesses[ALIAS_HOT_BUCKETS] = { 0 };
+  uint64_t aliased[ALIAS_HOT_BUCKETS] = { 0 };
+  uint64_t destructive[ALIAS_HOT_BUCKETS] = { 0 };
+
+  for (uint32_t i = 0; i < t->entries; i++) {
+    const alias_entry *e = &t->shadow[i];
+    if (e->accesses) {
+      int b = log2_bucket(e->accesses);
+      entries[b]++;
+      accesses[b] += e->accesses;
+      aliased[b] += e->aliased;
+      destructive[b] += e->destructive;
+    }
+  }
+
+  fprintf(out, "  %-23s %10s %10s %10s", "Accesses per entry", "Entries", "Accesses%",
+          "Aliased%");
+  fprintf(out, t->counter ? " %12s\n" : "\n", "Destructive%");
+  for (int b = 1; b < ALIAS_HOT_BUCKETS; b++) {
+    if (!entries[b]) {
+      continue;
+    }
+    char range[32];
+    uint64_t lo = (uint64_t)1 << (b - 1);
+    snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)lo,
+             (unsigned long long)(2 * lo - 1));
+    fprintf(out, "  %-23s %10llu %10.3f %10.3f", range, (unsigned long long)entries[b],
+            100.0 * accesses[b] / t->accesses,
+            t->aliased ? 100.0 * aliased[b] / t->aliased : 0.0);
+    if (t->counter) {
+      fprintf(out, " %12.3f", t->destructive ? 100.0 * destructive[b] / t->destructive : 0.0);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+void
+alias_report(const alias_analysis *s, FILE *out)
+{
+  for (int i = 0; i < s->ntables; i++) {
+    const alias_table *t = &s->tables[i];
+    uint64_t used = 0, shared = 0;
+    for (uint32_t j = 0; j < t->entries; j++) {
+      used += t->shadow[j].accesses != 0;
+      shared += t->shadow[j].aliased != 0;
+    }
+
+    fprintf(out, "Aliasing in %s (%u entries):\n", t->name, t->entries);
+    fprintf(out, "  Occupancy:     %12llu entries (%.3f%%), %llu shared by several PCs\n",
+            (unsigned long long)used, 100.0 * used / t->entries, (unsigned long long)shared);
+    fprintf(out, "  Aliased:       %12llu of %llu accesses (%.3f%%)\n",
+            (unsigned long long)t->aliased, (unsigned long long)t->accesses,
+            t->accesses ? 100.0 * t->aliased / t->accesses : 0.0);
+
+    // Only a disagreement with the private counter changes a
+    // prediction; the rest of the aliased accesses are neutral
+    if (t->counter) {
+      uint64_t neutral = t->aliased - t->constructive - t->destructive;
+      fprintf(out, "  Constructive:  %12llu (%.3f%% of aliased)\n",
+              (unsigned long long)t->constructive,
+              t->aliased ? 100.0 * t->constructive / t->aliased : 0.0);
+      fprintf(out, "  Destructive:   %12llu (%.3f%% of aliased)\n",
+              (unsigned long long)t->destructive,
+              t->aliased ? 100.0 * t->destructive / t->aliased : 0.0);
+      fprintf(out, "  Neutral:       %12llu (%.3f%% of aliased)\n",
+              (unsigned long long)neutral, t->aliased ? 100.0 * neutral / t->aliased : 0.0);
+      fprintf(out, "  Net cost:      %+12lld counter mispredictions (%+.3f%% of branches)\n",
+              (long long)(t->destructive - t->constructive),
+              s->branches ? 100.0 * ((double)t->destructive - t->constructive) / s->branches : 0.0);
+    }
+    report_histogram(t, out);
+  }
+}
+
+void
+alias_destroy(alias_analysis *s)
+{
+  for (int t = 0; t < s->ntables; t++) {
+    free(s->tables[t].shadow);
+  }
+  free(s->priv);
+  free(s);
+}
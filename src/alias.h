@@ -0,0 +1,81 @@
+//========================================================//
+//  alias.h                                               //
+//  Header file for the table aliasing analyser           //
+//                                                        //
+//  Every table entry is shadowed with the PC that last   //
+//  used it. A branch reaching an entry last used by      //
+//  another PC is an aliased access; for direction        //
+//  counters it is judged against a private counter that  //
+//  the same PC would have had to itself at that index:   //
+//  constructive if only the shared counter was right,    //
+//  destructive if only the private one was, else neutral //
+//========================================================//
+
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "predictor.h"
+
+#define ALIAS_MAX_BITS         22  // largest table shadowed, in index bits
+#define ALIAS_HOT_BUCKETS      33  // entries by log2 of their accesses
+#define ALIAS_INITIAL_PRIVATE  (1 << 16)
+
+typedef struct alias_entry {
+  uint32_t last_pc;
+  uint32_t accesses;      // 0: never used
+  uint32_t aliased;
+  uint32_t constructive;
+  uint32_t destructive;
+} alias_entry;
+
+typedef struct alias_table {
+  const char *name;
+  uint32_t entries;
+  int counter;            // judged against private counters
+  alias_entry *shadow;
+  uint64_t accesses;
+  uint64_t aliased;
+  uint64_t constructive;
+  uint64_t destructive;
+} alias_table;
+
+// Private 2-bit counter of one PC at one index of one table
+typedef struct alias_private {
+  uint32_t pc;
+  uint32_t index;
+  uint8_t table;          // 0: empty slot, else table number + 1
+  uint8_t state;
+} alias_private;
+
+typedef struct alias_analysis {
+  alias_table tables[BP_MAX_ACCESSES];
+  int ntables;
+  alias_private *priv;
+  uint32_t mask;          // slot count - 1, slot count is a power of 2
+  uint32_t used;
+  uint64_t branches;
+} alias_analysis;
+
+// Shadow the tables listed by one bp_accesses call
+//
+// Returns the analysis, or NULL if there are no tables or one
+// is too large to shadow
+//
+alias_analysis *alias_create(const bp_access *a, int n);
+
+// Record one branch from the entries its prediction read,
+// before the predictor is trained on it
+//
+void alias_record(alias_analysis *s, uint32_t pc, uint8_t outcome,
+                  const bp_access *a, int n);
+
+// Print occupancy, aliasing and the hot-entry histogram of
+// every table
+//
+void alias_report(const alias_analysis *s, FILE *out);
+
+void alias_destroy(alias_analysis *s);
+
+#endif
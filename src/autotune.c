@@ -0,0 +1,298 @@
+//========================================================//
+//  autotune.c                                            //
+//  Source file for the storage-budget autotuner          //
+//========================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "autotune.h"
+#include "predictor.h"
+#include "trace.h"
+#include "pool.h"
+
+// Branches handed to bp_simulate at a time
+#define AUTOTUNE_CHUNK  (1 << 20)
+
+typedef struct tune_candidate {
+  bp_config cfg;
+  uint64_t bits;            // storage, see bp_storage_bits
+  uint64_t branches;
+  uint64_t mispredictions;
+  int finalist;
+} tune_candidate;
+
+typedef struct tune_job {
+  const trace_data *traces;
+  int ntraces;
+  uint64_t limit;           // branches per trace, 0 for all
+  tune_candidate *c;
+} tune_job;
+
+typedef struct tune_load {
+  const char *path;
+  trace_data *data;
+  int ok;
+} tune_load;
+
+static void
+load_trace(void *arg)
+{
+  tune_load *load = (tune_load*)arg;
+  load->ok = trace_load(load->path, load->data);
+}
+
+// Run one candidate over (the start of) every trace, each trace
+// with a freshly initialized predictor
+//
+static void
+simulate_candidate(void *arg)
+{
+  tune_job *job = (tune_job*)arg;
+  tune_candidate *c = job->c;
+
+  c->branches = 0;
+  c->mispredictions = 0;
+  for (int t = 0; t < job->ntraces; t++) {
+    const trace_data *d = &job->traces[t];
+    uint64_t count = (job->limit && job->limit < d->count) ? job->limit : d->count;
+    bp_state *bp = bp_create(&c->cfg);
+    for (uint64_t pos = 0; pos < count; pos += AUTOTUNE_CHUNK) {
+      uint64_t left = count - pos;
+      int n = left < AUTOTUNE_CHUNK ? (int)left : AUTOTUNE_CHUNK;
+      c->mispredictions += bp_simulate(bp, d->pc + pos, d->outcome + pos, NULL, n);
+    }
+    c->branches += count;
+    bp_destroy(bp);
+  }
+}
+
+// Run the candidates selected by 'finalists_only' over the
+// first 'limit' branches of each trace
+//
+static void
+simulate_all(pool *p, tune_candidate *c, int n, int finalists_only,
+             const trace_data *traces, int ntraces, uint64_t limit)
+{
+  tune_job *jobs = (tune_job*)calloc(n, sizeof(tune_job));
+  for (int i = 0; i < n; i++) {
+    if (finalists_only && !c[i].finalist) {
+      continue;
+    }
+    jobs[i].traces = traces;
+    jobs[i].ntraces = ntraces;
+    jobs[i].limit = limit;
+    jobs[i].c = &c[i];
+    pool_submit(p, simulate_candidate, &jobs[i]);
+  }
+  pool_wait(p);
+  free(jobs);
+}
+
+static double
+candidate_rate(const tune_candidate *c)
+{
+  return c->branches ? 100.0 * c->mispredictions / c->branches : 0.0;
+}
+
+// Add 'cfg' to the candidates if it fits the budget
+//
+static void
+add_candidate(tune_candidate *c, int *n, const bp_config *cfg, uint64_t budget)
+{
+  uint64_t bits = bp_storage_bits(cfg);
+  if (bits > budget) {
+    return;
+  }
+  memset(&c[*n], 0, sizeof(c[*n]));
+  c[*n].cfg = *cfg;
+  c[*n].bits = bits;
+  (*n)++;
+}
+
+// Every geometry within the budget; c must have room for all
+//
+static int
+enumerate_candidates(tune_candidate *c, uint64_t budget)
+{
+  bp_config cfg;
+  int n = 0;
+
+  for (int g = AUTOTUNE_MIN_BITS; g <= AUTOTUNE_MAX_BITS; g++) {
+    bp_default_config(&cfg, GSHARE);
+    cfg.ghistoryBits = g;
+    add_candidate(c, &n, &cfg, budget);
+  }
+  for (int g = AUTOTUNE_MIN_BITS; g <= AUTOTUNE_MAX_BITS; g++) {
+    for (int l = AUTOTUNE_MIN_BITS; l <= AUTOTUNE_MAX_LOCAL; l++) {
+      for (int i = AUTOTUNE_MIN_BITS; i <= AUTOTUNE_MAX_LOCAL; i++) {
+        bp_default_config(&cfg, TOURNAMENT);
+        cfg.tour_historyBits = g;
+        cfg.lhistoryBits = l;
+        cfg.pcIndexBits = i;
+        add_candidate(c, &n, &cfg, budget);
+      }
+    }
+  }
+  for (int g = AUTOTUNE_MIN_BITS; g <= AUTOTUNE_MAX_BITS; g++) {
+    bp_default_config(&cfg, CUSTOM);
+    cfg.ghistoryBits = g;
+    add_candidate(c, &n, &cfg, budget);
+  }
+
+  return n;
+}
+
+static int
+compare_bits(const void *a, const void *b)
+{
+  const tune_candidate *x = *(const tune_candidate**)a;
+  const tune_candidate *y = *(const tune_candidate**)b;
+  if (x->bits != y->bits) {
+    return x->bits < y->bits ? -1 : 1;
+  }
+  return x->mispredictions < y->mispredictions ? -1 : (x->mispredictions > y->mispredictions);
+}
+
+static int
+compare_rate(const void *a, const void *b)
+{
+  double x = candidate_rate(*(const tune_candidate**)a);
+  double y = candidate_rate(*(const tune_candidate**)b);
+  return x < y ? -1 : (x > y);
+}
+
+// Reduce the 'n' candidates in 'list' to those no smaller one
+// is at least as accurate as, in order of size
+//
+// Returns the number kept
+//
+static int
+pareto_frontier(tune_candidate **list, int n)
+{
+  int kept = 0;
+  qsort(list, n, sizeof(*list), compare_bits);
+  for (int i = 0; i < n; i++) {
+    if (kept == 0 || candidate_rate(list[i]) < candidate_rate(list[kept - 1])) {
+      list[kept++] = list[i];
+    }
+  }
+  return kept;
+}
+
+// Mark the most accurate frontier points of one scheme, by
+// their screening results, for the full run
+//
+static int
+pick_finalists(tune_candidate *c, int n, int type, tune_candidate **list)
+{
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    if (c[i].cfg.bpType == type) {
+      list[count++] = &c[i];
+    }
+  }
+  count = pareto_frontier(list, count);
+  qsort(list, count, sizeof(*list), compare_rate);
+  if (count > AUTOTUNE_FINALISTS) {
+    count = AUTOTUNE_FINALISTS;
+  }
+  for (int i = 0; i < count; i++) {
+    list[i]->finalist = 1;
+  }
+  return count;
+}
+
+// Print the full-run frontier of one scheme
+//
+static void
+report_scheme(tune_candidate *c, int n, int type, tune_candidate **list)
+{
+  int screened = 0;
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    if (c[i].cfg.bpType != type) {
+      continue;
+    }
+    screened++;
+    if (c[i].finalist) {
+      list[count++] = &c[i];
+    }
+  }
+
+  printf("\n%s: %d geometries fit, %d run in full\n", bpName[type], screened, count);
+  if (count == 0) {
+    return;
+  }
+  count = pareto_frontier(list, count);
+
+  // Gain is the misprediction rate saved per extra KB over the
+  // smallest configuration listed
+  printf("  %-26s %10s %9s %9s %12s\n", "Predictor", "Bits", "KB", "Rate", "Gain/KB");
+  for (int i = 0; i < count; i++) {
+    char name[48];
+    double kb = list[i]->bits / 8192.0;
+    bp_format_config(&list[i]->cfg, name, sizeof(name));
+    printf("  %-26s %10llu %9.2f %9.3f", name, (unsigned long long)list[i]->bits,
+           kb, candidate_rate(list[i]));
+    if (i > 0) {
+      double gain = candidate_rate(list[0]) - candidate_rate(list[i]);
+      printf(" %12.3f", gain / (kb - list[0]->bits / 8192.0));
+    }
+    printf("%s\n", i == count - 1 ? "  <- best" : "");
+  }
+}
+
+int
+autotune_run(const char **traces, int ntraces, uint64_t budget, int nthreads)
+{
+  int max = (AUTOTUNE_MAX_BITS + 1) * (AUTOTUNE_MAX_LOCAL + 1) * (AUTOTUNE_MAX_LOCAL + 1) +
+            2 * (AUTOTUNE_MAX_BITS + 1);
+  tune_candidate *c = (tune_candidate*)malloc(max * sizeof(tune_candidate));
+  tune_candidate **list = (tune_candidate**)malloc(max * sizeof(tune_candidate*));
+  trace_data *data = (trace_data*)calloc(ntraces, sizeof(trace_data));
+  tune_load *loads = (tune_load*)calloc(ntraces, sizeof(tune_load));
+  pool *p = pool_create(nthreads);
+  int types[] = { GSHARE, TOURNAMENT, CUSTOM };
+  uint64_t branches = 0;
+  int ok = 1;
+
+  // Decode every trace once; both passes read the same copy
+  for (int t = 0; t < ntraces; t++) {
+    loads[t].path = traces[t];
+    loads[t].data = &data[t];
+    pool_submit(p, load_trace, &loads[t]);
+  }
+  pool_wait(p);
+  for (int t = 0; t < ntraces; t++) {
+    ok &= loads[t].ok;
+    branches += data[t].count;
+  }
+
+  int n = ok ? enumerate_candidates(c, budget) : 0;
+  if (ok) {
+    printf("Budget %llu bits (%.2f KB), %d traces, %llu branches, %d geometries\n",
+           (unsigned long long)budget, budget / 8192.0, ntraces,
+           (unsigned long long)branches, n);
+    fflush(stdout);
+
+    simulate_all(p, c, n, 0, data, ntraces, AUTOTUNE_SCREEN);
+    for (int i = 0; i < 3; i++) {
+      pick_finalists(c, n, types[i], list);
+    }
+    simulate_all(p, c, n, 1, data, ntraces, 0);
+    for (int i = 0; i < 3; i++) {
+      report_scheme(c, n, types[i], list);
+    }
+  }
+
+  pool_destroy(p);
+  for (int t = 0; t < ntraces; t++) {
+    trace_free(&data[t]);
+  }
+  free(loads);
+  free(data);
+  free(list);
+  free(c);
+  return ok;
+}
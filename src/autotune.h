@@ -0,0 +1,32 @@
+//========================================================//
+//  autotune.h                                            //
+//  Header file for the storage-budget autotuner          //
+//                                                        //
+//  Every gshare, tournament and custom geometry that     //
+//  fits the budget is screened on the start of each      //
+//  trace; the most accurate few per scheme are then run  //
+//  over the whole traces. All runs share one decoded     //
+//  copy of each trace and spread over a thread pool      //
+//========================================================//
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdint.h>
+
+#define AUTOTUNE_SCREEN     (1 << 18) // branches per trace in the screening pass
+#define AUTOTUNE_FINALISTS  4         // geometries per scheme run in full
+#define AUTOTUNE_MIN_BITS   4         // smallest table index / history searched
+#define AUTOTUNE_MAX_BITS   20        // largest table index searched
+#define AUTOTUNE_MAX_LOCAL  16        // largest local history / local index searched
+
+// Search for the best geometries within 'budget' bits of storage
+// (see bp_storage_bits) over the given traces on 'nthreads'
+// workers and print, per scheme, the finalists that no smaller
+// finalist beats, with their accuracy per KB
+//
+// Returns True if every trace could be read
+//
+int autotune_run(const char **traces, int ntraces, uint64_t budget, int nthreads);
+
+#endif
@@ -0,0 +1,166 @@
+#!/bin/sh
+#========================================================#
+#  bench.sh                                              #
+#  Benchmark every predictor over every bundled trace    #
+#                                                        #
+#  Records misprediction rate, simulated branches per    #
+#  second and peak memory for each (trace, predictor)    #
+#  pair as JSON, one result per line. Given a saved      #
+#  baseline it flags pairs that got less accurate or     #
+#  slower than the tolerance allows                      #
+#                                                        #
+#  The traces are converted to the binary format once,   #
+#  so the runs time the predictors rather than bzip2     #
+#========================================================#
+
+# The defaults, and geometries large enough for the batched
+# kernels to prefetch their tables
+PREDICTORS="static gshare tournament custom gshare:20 tournament:18:12:15"
+TRACES="fp_1 fp_2 int_1 int_2 mm_1 mm_2"
+TRACE_DIR=../traces
+OUT=bench.json
+BASELINE=
+TOLERANCE=10   # percent throughput drop tolerated
+REPEATS=5      # rounds, each pair runs in every one; the fastest run is kept
+MIN_TIME=1     # seconds per pair at least, the small traces run more
+
+usage()
+{
+  echo "Usage: bench.sh [-o <out.json>] [-c <baseline.json>] [-t <percent>] [-r <rounds>]" >&2
+  echo "                [-m <seconds>]" >&2
+  echo " -o  Write results to <out.json> (default $OUT)" >&2
+  echo " -c  Compare against <baseline.json>, exit 1 on a regression" >&2
+  echo " -t  Throughput drop tolerated before flagging (default $TOLERANCE%)" >&2
+  echo " -r  Rounds over all pairs, keeping the fastest run (default $REPEATS)" >&2
+  echo " -m  Seconds per pair at least, over all rounds (default $MIN_TIME)" >&2
+}
+
+while getopts "o:c:t:r:m:h" opt; do
+  case $opt in
+    o) OUT=$OPTARG ;;
+    c) BASELINE=$OPTARG ;;
+    t) TOLERANCE=$OPTARG ;;
+    r) REPEATS=$OPTARG ;;
+    m) MIN_TIME=$OPTARG ;;
+    *) usage; exit 1 ;;
+  esac
+done
+
+if [ ! -x ./predictor ]; then
+  echo "bench.sh: build the predictor first (make)" >&2
+  exit 1
+fi
+if [ -n "$BASELINE" ] && [ ! -r "$BASELINE" ]; then
+  echo "bench.sh: cannot read baseline $BASELINE" >&2
+  exit 1
+fi
+
+# Convert every trace once
+BPT_DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$BPT_DIR" "$OUT.tmp"' EXIT
+for t in $TRACES; do
+  ./predictor --convert:"$BPT_DIR/$t.bpt" "$TRACE_DIR/$t.bz2" > /dev/null ||
+    { echo "bench.sh: cannot convert $TRACE_DIR/$t.bz2" >&2; exit 1; }
+done
+
+# Run one pair for at least MIN_TIME / REPEATS seconds, keeping
+# the throughput and JSON fields of its fastest run so far in
+# $BPT_DIR/<trace>.<predictor>
+#
+run_burst()
+{
+  result="$BPT_DIR/$1.$2"
+  spent=0
+  while :; do
+    fields=$(./predictor --$2 --stats "$BPT_DIR/$1.bpt" | awk '
+      /^Branches:/           { branches = $2 }
+      /^Incorrect:/          { incorrect = $2 }
+      /^Misprediction Rate:/ { rate = $3 }
+      /^Elapsed:/            { elapsed = $2 }
+      /^Throughput:/         { bps = $2 * 1000000 }
+      /^Peak RSS:/           { rss = $3 }
+      END {
+        if (branches == "") exit 1
+        printf "%s %.0f ", elapsed, bps
+        printf "\"branches\": %d, \"mispredictions\": %d, \"misprediction_rate\": %s, ", branches, incorrect, rate
+        printf "\"branches_per_sec\": %.0f, \"peak_rss_kb\": %d\n", bps, rss
+      }') || return 1
+    spent=$(awk -v s="$spent" -v e="${fields%% *}" 'BEGIN { print s + e }')
+    fields=${fields#* }
+    if [ ! -r "$result" ] || [ "${fields%% *}" -gt "$(cut -d' ' -f1 "$result")" ]; then
+      echo "$fields" > "$result"
+    fi
+    awk -v s="$spent" -v m="$MIN_TIME" -v r="$REPEATS" 'BEGIN { exit !(s < m / r) }' || return 0
+  done
+}
+
+# The pairs take turns, a burst each per round, so a slow spell
+# of the machine costs a pair some of its runs rather than all
+round=1
+while [ $round -le "$REPEATS" ]; do
+  for t in $TRACES; do
+    for p in $PREDICTORS; do
+      run_burst $t $p || { echo "bench.sh: $p on $t failed" >&2; exit 1; }
+    done
+  done
+  echo "Round $round of $REPEATS done" >&2
+  round=$((round + 1))
+done
+
+# Collect the results
+{
+  echo "{"
+  echo "  \"commit\": \"$(git rev-parse --short HEAD 2>/dev/null)\","
+  echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+  echo "  \"results\": ["
+  sep=
+  for t in $TRACES; do
+    for p in $PREDICTORS; do
+      printf '%s    {"trace": "%s", "predictor": "%s", %s}' "$sep" $t $p \
+             "$(cut -d' ' -f2- "$BPT_DIR/$t.$p")"
+      sep=",
+"
+    done
+  done
+  echo
+  echo "  ]"
+  echo "}"
+} > "$OUT.tmp" || exit 1
+mv "$OUT.tmp" "$OUT"
+echo "Results written to $OUT"
+
+if [ -z "$BASELINE" ]; then
+  exit 0
+fi
+
+# Compare pair by pair: any extra misprediction is a regression
+# (the simulation is deterministic), throughput only beyond the
+# tolerance since it is noisy
+awk -v tol="$TOLERANCE" -v base="$BASELINE" '
+  function field(line, name,    s) {
+    s = line
+    if (!sub(".*\"" name "\": \"?", "", s)) return ""
+    sub("[\",}].*", "", s)
+    return s
+  }
+  FILENAME == base && /"trace":/ {
+    key = field($0, "trace") " " field($0, "predictor")
+    base_miss[key] = field($0, "mispredictions")
+    base_bps[key] = field($0, "branches_per_sec")
+    next
+  }
+  /"trace":/ {
+    key = field($0, "trace") " " field($0, "predictor")
+    if (!(key in base_miss)) { printf "%-26s not in baseline\n", key; next }
+    miss = field($0, "mispredictions"); bps = field($0, "branches_per_sec")
+    speed = 100 * (bps - base_bps[key]) / base_bps[key]
+    flag = ""
+    if (miss + 0 > base_miss[key] + 0) flag = flag " ACCURACY"
+    if (speed < -tol) flag = flag " THROUGHPUT"
+    printf "%-26s mispredictions %+8d  throughput %+6.1f%%%s\n", key, miss - base_miss[key], speed, flag
+    if (flag != "") bad++
+  }
+  END {
+    if (bad) { printf "%d regression(s) against %s\n", bad, base; exit 1 }
+    printf "No regressions against %s\n", base
+  }' "$BASELINE" "$OUT"
@@ -0,0 +1,564 @@
+//========================================================//
+//  column.c                                              //
+//  Source file for the columnar trace codec              //
+//========================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "column.h"
+
+// Probabilities are of a 1 bit, in COL_PROB_BITS fixed point,
+// and move 1/2^COL_PROB_SHIFT of the way to each coded bit
+#define COL_PROB_BITS   16
+#define COL_PROB_SHIFT  5
+#define COL_PROB_INIT   (1 << (COL_PROB_BITS - 1))
+
+// The coder renormalises a byte at a time below this range
+#define COL_RANGE_TOP   (1u << 24)
+
+//------------------------------------//
+//               Model                //
+//------------------------------------//
+
+// Successors seen after one hashed path
+typedef struct col_slot {
+  uint32_t next[2];   // last two successor indices, newest first
+  uint16_t p_hit;     // newest is the next branch
+  uint16_t p_alt;     // older one is, when the newest is not
+} col_slot;
+
+typedef struct col_model {
+  col_slot *slots;
+  uint16_t *p_outcome;
+  uint16_t *local;    // local history per PC index
+  uint32_t local_cap;
+  uint32_t seen;      // dictionary entries met so far
+  uint32_t prev;      // index << 1 | outcome of the last branch
+  uint32_t path;      // and of the ones before it, folded
+  uint32_t global;    // recent outcomes, newest in bit 0
+  uint16_t p_new;     // a miss on both successors is a new PC
+} col_model;
+
+static void
+model_init(col_model *m, uint32_t pcs)
+{
+  memset(m, 0, sizeof(*m));
+  m->slots = (col_slot*)calloc(1 << COL_SLOT_BITS, sizeof(col_slot));
+  for (int i = 0; i < (1 << COL_SLOT_BITS); i++) {
+    m->slots[i].p_hit = COL_PROB_INIT;
+    m->slots[i].p_alt = COL_PROB_INIT;
+  }
+  m->p_outcome = (uint16_t*)malloc((1 << COL_CONTEXT_BITS) * sizeof(uint16_t));
+  for (int i = 0; i < (1 << COL_CONTEXT_BITS); i++) {
+    m->p_outcome[i] = COL_PROB_INIT;
+  }
+  m->local_cap = pcs > 0 ? pcs : 1;
+  m->local = (uint16_t*)calloc(m->local_cap, sizeof(uint16_t));
+  m->p_new = COL_PROB_INIT;
+}
+
+static void
+model_free(col_model *m)
+{
+  free(m->slots);
+  free(m->p_outcome);
+  free(m->local);
+}
+
+// Bits needed to name any existing index
+static inline int
+model_index_bits(const col_model *m)
+{
+  return m->seen > 1 ? 32 - __builtin_clz(m->seen - 1) : 0;
+}
+
+static inline col_slot *
+model_slot(col_model *m)
+{
+  uint32_t h = (m->prev * 0x9E3779B1u) ^ (m->path * 0x85EBCA6Bu);
+  return &m->slots[h >> (32 - COL_SLOT_BITS)];
+}
+
+static inline uint16_t *
+model_outcome(col_model *m, uint32_t index)
+{
+  uint32_t history = ((uint32_t)m->local[index] << COL_GLOBAL_BITS) |
+                     (m->global & ((1u << COL_GLOBAL_BITS) - 1));
+  uint32_t h = (index * 0x9E3779B1u) ^ (history * 0x85EBCA6Bu);
+  return &m->p_outcome[h >> (32 - COL_CONTEXT_BITS)];
+}
+
+// Move past a branch whose index came through 's'
+static inline void
+model_advance(col_model *m, col_slot *s, uint32_t index, uint8_t outcome)
+{
+  if (s->next[0] != index) {
+    s->next[1] = s->next[0];
+    s->next[0] = index;
+  }
+  if (index == m->seen) {
+    m->seen++;
+  }
+  m->local[index] = ((m->local[index] << 1) | outcome) & ((1u << COL_LOCAL_BITS) - 1);
+  m->global = (m->global << 1) | outcome;
+  m->path = ((m->path << 5) ^ m->prev) & ((1u << COL_PATH_BITS) - 1);
+  m->prev = (index << 1) | outcome;
+}
+
+static inline void
+prob_update(uint16_t *p, int bit)
+{
+  if (bit) {
+    *p += ((1u << COL_PROB_BITS) - *p) >> COL_PROB_SHIFT;
+  } else {
+    *p -= *p >> COL_PROB_SHIFT;
+  }
+}
+
+//------------------------------------//
+//            Range Coding            //
+//------------------------------------//
+
+typedef struct col_buffer {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+} col_buffer;
+
+typedef struct col_encoder {
+  col_buffer out;
+  uint64_t low;
+  uint32_t range;
+  uint8_t cache;      // last byte not yet final, a carry may reach it
+  uint64_t pending;   // bytes held back: the cache and 0xFFs after it
+} col_encoder;
+
+typedef struct col_decoder {
+  const uint8_t *p;
+  const uint8_t *end;
+  uint32_t range;
+  uint32_t code;
+} col_decoder;
+
+static void
+buffer_put(col_buffer *b, const void *data, size_t len)
+{
+  if (b->len + len > b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 1 << 16;
+    while (b->len + len > b->cap) {
+      b->cap *= 2;
+    }
+    b->data = (uint8_t*)realloc(b->data, b->cap);
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static void
+encoder_init(col_encoder *e)
+{
+  memset(e, 0, sizeof(*e));
+  e->range = 0xFFFFFFFFu;
+  e->pending = 1;
+}
+
+static void
+encoder_shift(col_encoder *e)
+{
+  if ((uint32_t)e->low < 0xFF000000u || (e->low >> 32) != 0) {
+    uint8_t carry = (uint8_t)(e->low >> 32);
+    uint8_t byte = e->cache;
+    do {
+      uint8_t out = byte + carry;
+      buffer_put(&e->out, &out, 1);
+      byte = 0xFF;
+    } while (--e->pending);
+    e->cache = (uint8_t)(e->low >> 24);
+  }
+  e->pending++;
+  e->low = (e->low & 0x00FFFFFFu) << 8;
+}
+
+static inline void
+encode_bit(col_encoder *e, uint16_t *p, int bit)
+{
+  uint32_t bound = (e->range >> COL_PROB_BITS) * *p;
+  if (bit) {
+    e->range = bound;
+  } else {
+    e->low += bound;
+    e->range -= bound;
+  }
+  prob_update(p, bit);
+  while (e->range < COL_RANGE_TOP) {
+    e->range <<= 8;
+    encoder_shift(e);
+  }
+}
+
+// 'bits' equiprobable bits of 'value', most significant first
+static void
+encode_direct(col_encoder *e, uint32_t value, int bits)
+{
+  while (bits-- > 0) {
+    e->range >>= 1;
+    if ((value >> bits) & 1) {
+      e->low += e->range;
+    }
+    while (e->range < COL_RANGE_TOP) {
+      e->range <<= 8;
+      encoder_shift(e);
+    }
+  }
+}
+
+static void
+encoder_flush(col_encoder *e)
+{
+  for (int i = 0; i < 5; i++) {
+    encoder_shift(e);
+  }
+}
+
+// Past the end of its column a decoder reads zeros
+static inline uint8_t
+decoder_byte(col_decoder *d)
+{
+  return d->p < d->end ? *d->p++ : 0;
+}
+
+static void
+decoder_init(col_decoder *d, const uint8_t *data, size_t len)
+{
+  d->p = data;
+  d->end = data + len;
+  d->range = 0xFFFFFFFFu;
+  d->code = 0;
+  for (int i = 0; i < 5; i++) {
+    d->code = (d->code << 8) | decoder_byte(d);
+  }
+}
+
+static inline int
+decode_bit(col_decoder *d, uint16_t *p)
+{
+  uint32_t bound = (d->range >> COL_PROB_BITS) * *p;
+  int bit;
+  if (d->code < bound) {
+    d->range = bound;
+    bit = 1;
+  } else {
+    d->code -= bound;
+    d->range -= bound;
+    bit = 0;
+  }
+  prob_update(p, bit);
+  while (d->range < COL_RANGE_TOP) {
+    d->range <<= 8;
+    d->code = (d->code << 8) | decoder_byte(d);
+  }
+  return bit;
+}
+
+static uint32_t
+decode_direct(col_decoder *d, int bits)
+{
+  uint32_t value = 0;
+  while (bits-- > 0) {
+    d->range >>= 1;
+    uint32_t bit = d->code >= d->range;
+    if (bit) {
+      d->code -= d->range;
+    }
+    value = (value << 1) | bit;
+    while (d->range < COL_RANGE_TOP) {
+      d->range <<= 8;
+      d->code = (d->code << 8) | decoder_byte(d);
+    }
+  }
+  return value;
+}
+
+//------------------------------------//
+//              Decoding              //
+//------------------------------------//
+
+struct trace_col {
+  col_model m;
+  col_decoder index;
+  col_decoder outcome;
+  uint32_t *dict;
+  uint32_t pcs;
+  uint64_t count;
+  uint64_t pos;
+};
+
+int
+col_is_header(const uint8_t *data, size_t size)
+{
+  trace_col_header hdr;
+  if (size < TRACE_COL_HEADER_SIZE) {
+    return 0;
+  }
+  memcpy(&hdr, data, TRACE_COL_HEADER_SIZE);
+  return !memcmp(hdr.magic, TRACE_COL_MAGIC, 4) && hdr.version == TRACE_COL_VERSION;
+}
+
+// Read the zigzag varint deltas of 'pcs' dictionary entries
+//
+// Returns True if they fill [p, end) exactly
+//
+static int
+read_dictionary(const uint8_t *p, const uint8_t *end, uint32_t *dict, uint32_t pcs)
+{
+  uint32_t pc = 0;
+  for (uint32_t i = 0; i < pcs; i++) {
+    uint32_t v = 0;
+    int shift = 0;
+    do {
+      if (p == end || shift > 28) {
+        return 0;
+      }
+      v |= (uint32_t)(*p & 0x7F) << shift;
+      shift += 7;
+    } while (*p++ & 0x80);
+    pc += (v >> 1) ^ -(v & 1);
+    dict[i] = pc;
+  }
+  return p == end;
+}
+
+trace_col *
+col_open(const uint8_t *data, size_t size, uint64_t *count)
+{
+  trace_col_header hdr;
+  memcpy(&hdr, data, TRACE_COL_HEADER_SIZE);
+
+  uint64_t avail = size - TRACE_COL_HEADER_SIZE;
+  if (hdr.dict_size > avail || hdr.index_size > avail - hdr.dict_size ||
+      hdr.outcome_size > avail - hdr.dict_size - hdr.index_size) {
+    fprintf(stderr, "Truncated columnar trace\n");
+    return NULL;
+  }
+  if (hdr.pcs > hdr.count || (hdr.count > 0 && hdr.pcs == 0)) {
+    fprintf(stderr, "Columnar trace has %u PCs for %llu branches\n", hdr.pcs,
+            (unsigned long long)hdr.count);
+    return NULL;
+  }
+
+  trace_col *c = (trace_col*)calloc(1, sizeof(trace_col));
+  const uint8_t *dict = data + TRACE_COL_HEADER_SIZE;
+  const uint8_t *index = dict + hdr.dict_size;
+  const uint8_t *outcome = index + hdr.index_size;
+  c->dict = (uint32_t*)malloc((hdr.pcs ? hdr.pcs : 1) * sizeof(uint32_t));
+  if (!read_dictionary(dict, index, c->dict, hdr.pcs)) {
+    fprintf(stderr, "Corrupt columnar trace dictionary\n");
+    free(c->dict);
+    free(c);
+    return NULL;
+  }
+  c->pcs = hdr.pcs;
+  c->count = hdr.count;
+  model_init(&c->m, hdr.pcs);
+  decoder_init(&c->index, index, hdr.index_size);
+  decoder_init(&c->outcome, outcome, hdr.outcome_size);
+
+  *count = hdr.count;
+  return c;
+}
+
+int
+col_decode(trace_col *c, trace_batch *batch)
+{
+  col_model *m = &c->m;
+  uint64_t left = c->count - c->pos;
+  int n = left < TRACE_BATCH ? (int)left : TRACE_BATCH;
+
+  for (int i = 0; i < n; i++) {
+    col_slot *s = model_slot(m);
+    uint32_t index = s->next[0];
+    if (!decode_bit(&c->index, &s->p_hit)) {
+      index = s->next[1];
+      if (!decode_bit(&c->index, &s->p_alt)) {
+        index = decode_bit(&c->index, &m->p_new) ? m->seen
+                                                 : decode_direct(&c->index, model_index_bits(m));
+      }
+    }
+    // a hit can only name an index met before, the rest is corrupt
+    if (index > m->seen || index >= c->pcs) {
+      fprintf(stderr, "Corrupt columnar trace at branch %llu\n",
+              (unsigned long long)(c->pos + i));
+      c->pos = c->count;
+      batch->n = i;
+      return i;
+    }
+    uint8_t outcome = decode_bit(&c->outcome, model_outcome(m, index));
+    model_advance(m, s, index, outcome);
+    batch->pc[i] = c->dict[index];
+    batch->outcome[i] = outcome;
+  }
+
+  c->pos += n;
+  batch->n = n;
+  return n;
+}
+
+void
+col_close(trace_col *c)
+{
+  if (!c) {
+    return;
+  }
+  model_free(&c->m);
+  free(c->dict);
+  free(c);
+}
+
+//------------------------------------//
+//              Encoding              //
+//------------------------------------//
+
+// PC -> dictionary index, open addressing
+typedef struct col_map {
+  uint32_t *pc;
+  uint32_t *index;    // UINT32_MAX marks an empty slot
+  uint32_t mask;
+  uint32_t used;
+} col_map;
+
+static void
+map_init(col_map *map, uint32_t slots)
+{
+  map->pc = (uint32_t*)malloc(slots * sizeof(uint32_t));
+  map->index = (uint32_t*)malloc(slots * sizeof(uint32_t));
+  memset(map->index, 0xFF, slots * sizeof(uint32_t));
+  map->mask = slots - 1;
+  map->used = 0;
+}
+
+static uint32_t *
+map_find(col_map *map, uint32_t pc)
+{
+  uint32_t i = (pc * 0x9E3779B1u) & map->mask;
+  while (map->index[i] != UINT32_MAX && map->pc[i] != pc) {
+    i = (i + 1) & map->mask;
+  }
+  map->pc[i] = pc;
+  return &map->index[i];
+}
+
+// Index of 'pc', adding it as 'next' if it is new
+static uint32_t
+map_index(col_map *map, uint32_t pc, uint32_t next)
+{
+  uint32_t *slot = map_find(map, pc);
+  if (*slot != UINT32_MAX) {
+    return *slot;
+  }
+  *slot = next;
+
+  // keep the table at most half full
+  if (++map->used * 2 > map->mask) {
+    col_map grown;
+    map_init(&grown, (map->mask + 1) * 2);
+    for (uint32_t i = 0; i <= map->mask; i++) {
+      if (map->index[i] != UINT32_MAX) {
+        *map_find(&grown, map->pc[i]) = map->index[i];
+      }
+    }
+    grown.used = map->used;
+    free(map->pc);
+    free(map->index);
+    *map = grown;
+  }
+  return next;
+}
+
+static void
+put_varint(col_buffer *b, uint32_t v)
+{
+  uint8_t bytes[5];
+  int n = 0;
+  while (v >= 0x80) {
+    bytes[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  bytes[n++] = v;
+  buffer_put(b, bytes, n);
+}
+
+int64_t
+col_encode(trace_reader *t, FILE *out)
+{
+  trace_batch *batch = (trace_batch*)malloc(sizeof(trace_batch));
+  col_buffer dict = { NULL, 0, 0 };
+  col_encoder index, outcome;
+  col_model m;
+  col_map map;
+  uint32_t last_pc = 0;
+  uint64_t count = 0;
+
+  model_init(&m, 1 << 10);
+  map_init(&map, 1 << 12);
+  encoder_init(&index);
+  encoder_init(&outcome);
+
+  while (trace_read_batch(t, batch) > 0) {
+    for (int i = 0; i < batch->n; i++) {
+      uint32_t pc = batch->pc[i];
+      uint8_t taken = batch->outcome[i] != 0;
+      uint32_t k = map_index(&map, pc, m.seen);
+      if (k == m.seen) {
+        put_varint(&dict, ((pc - last_pc) << 1) ^ -((pc - last_pc) >> 31));
+        last_pc = pc;
+        if (k == m.local_cap) {
+          m.local = (uint16_t*)realloc(m.local, 2 * m.local_cap * sizeof(uint16_t));
+          memset(m.local + m.local_cap, 0, m.local_cap * sizeof(uint16_t));
+          m.local_cap *= 2;
+        }
+      }
+
+      // mirrors col_decode
+      col_slot *s = model_slot(&m);
+      encode_bit(&index, &s->p_hit, s->next[0] == k);
+      if (s->next[0] != k) {
+        encode_bit(&index, &s->p_alt, s->next[1] == k);
+        if (s->next[1] != k) {
+          encode_bit(&index, &m.p_new, k == m.seen);
+          if (k != m.seen) {
+            encode_direct(&index, k, model_index_bits(&m));
+          }
+        }
+      }
+      encode_bit(&outcome, model_outcome(&m, k), taken);
+      model_advance(&m, s, k, taken);
+    }
+    count += batch->n;
+  }
+  encoder_flush(&index);
+  encoder_flush(&outcome);
+
+  trace_col_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, TRACE_COL_MAGIC, 4);
+  hdr.version = TRACE_COL_VERSION;
+  hdr.count = count;
+  hdr.pcs = m.seen;
+  hdr.dict_size = dict.len;
+  hdr.index_size = index.out.len;
+  hdr.outcome_size = outcome.out.len;
+  int ok = fwrite(&hdr, TRACE_COL_HEADER_SIZE, 1, out) == 1 &&
+           fwrite(dict.data, 1, dict.len, out) == dict.len &&
+           fwrite(index.out.data, 1, index.out.len, out) == index.out.len &&
+           fwrite(outcome.out.data, 1, outcome.out.len, out) == outcome.out.len;
+
+  model_free(&m);
+  free(map.pc);
+  free(map.index);
+  free(dict.data);
+  free(index.out.data);
+  free(outcome.out.data);
+  free(batch);
+  return ok ? (int64_t)count : -1;
+}
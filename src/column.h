@@ -0,0 +1,54 @@
+//========================================================//
+//  column.h                                              //
+//  Header file for the columnar trace codec              //
+//                                                        //
+//  Branches are coded against a small model that both    //
+//  sides update identically: the PC index as a hit or    //
+//  miss on the successor last seen after the same        //
+//  recent path, the outcome under the PC's local history //
+//  and the newest global outcomes. Each column has its   //
+//  own binary range coder with adaptive probabilities    //
+//========================================================//
+
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <stdint.h>
+#include "trace.h"
+
+#define COL_SLOT_BITS     18  // successor slots, hashed from the path
+#define COL_PATH_BITS     15  // earlier branches folded into the path
+#define COL_CONTEXT_BITS  20  // outcome probabilities, hashed
+#define COL_LOCAL_BITS    12  // local history per PC in the outcome context
+#define COL_GLOBAL_BITS   2   // global outcomes in the outcome context
+
+// Check a header read from the start of a trace
+//
+// Returns True for a columnar trace
+//
+int col_is_header(const uint8_t *data, size_t size);
+
+// Validate the columnar trace in the 'size' bytes at 'data'
+// (which must stay mapped) and set up its decoder
+//
+// Returns the decoder, or NULL if the trace is malformed
+//
+trace_col *col_open(const uint8_t *data, size_t size, uint64_t *count);
+
+// Decode up to TRACE_BATCH branches into 'batch'
+//
+// Returns the number decoded, 0 at the end of the trace
+//
+int col_decode(trace_col *c, trace_batch *batch);
+
+// Free a decoder
+//
+void col_close(trace_col *c);
+
+// Encode the remainder of 't' into 'out' as a columnar trace
+//
+// Returns the number of branches written, or -1 on error
+//
+int64_t col_encode(trace_reader *t, FILE *out);
+
+#endif
@@ -0,0 +1,35 @@
+//========================================================//
+//  counter.h                                             //
+//  Branchless saturating counters                        //
+//                                                        //
+//  An n-bit counter counts up on taken and down on not   //
+//  taken, saturating at 0 and 2^n - 1; its top bit is    //
+//  the predicted direction. With n = 2 the values match  //
+//  SN/WN/WT/ST in predictor.h                            //
+//========================================================//
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdint.h>
+
+// Move an n-bit counter one step towards 'taken'
+//
+static inline uint8_t
+ctr_update(uint8_t c, uint8_t taken, int bits)
+{
+  uint8_t max = (uint8_t)((1 << bits) - 1);
+  uint8_t up = taken & (c != max);
+  uint8_t down = (taken ^ 1) & (c != 0);
+  return c + up - down;
+}
+
+// Direction predicted by an n-bit counter
+//
+static inline uint8_t
+ctr_taken(uint8_t c, int bits)
+{
+  return (c >> (bits - 1)) & 1;
+}
+
+#endif
@@ -0,0 +1,263 @@
+//========================================================//
+//  daemon.c                                              //
+//  Source file for the streaming daemon mode             //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+static const uint32_t defaultWindows[] = { 10000, 100000, 1000000 };
+
+volatile sig_atomic_t daemonReportDue = 0;
+static volatile sig_atomic_t stopping = 0;
+
+static void
+on_timer(int sig)
+{
+  (void)sig;
+  daemonReportDue = 1;
+}
+
+static void
+on_stop(int sig)
+{
+  (void)sig;
+  stopping = 1;
+  daemonReportDue = 1;
+}
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int
+daemon_parse_windows(const char *spec, daemon_plan *plan)
+{
+  plan->numWindows = 0;
+  const char *p = spec;
+  for (;;) {
+    char *end;
+    unsigned long long n = strtoull(p, &end, 10);
+    if (end == p || n == 0 || n > DAEMON_MAX_WINDOW ||
+        plan->numWindows == DAEMON_MAX_WINDOWS) {
+      return 0;
+    }
+    plan->windows[plan->numWindows++] = (uint32_t)n;
+    if (!*end) {
+      return 1;
+    }
+    if (*end != ',') {
+      return 0;
+    }
+    p = end + 1;
+  }
+}
+
+// Listen on a Unix domain socket at 'path', replacing a stale
+// socket left by an earlier daemon
+//
+// Returns the listening descriptor, or -1
+//
+static int
+listen_socket(const char *path)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path %s is too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int
+daemon_open(daemon_state *d, const daemon_plan *plan, FILE *out)
+{
+  memset(d, 0, sizeof(*d));
+  d->plan = *plan;
+  d->out = out;
+  if (d->plan.numWindows == 0) {
+    d->plan.numWindows = sizeof(defaultWindows) / sizeof(defaultWindows[0]);
+    memcpy(d->plan.windows, defaultWindows, sizeof(defaultWindows));
+  }
+  if (d->plan.interval == 0) {
+    d->plan.interval = DAEMON_DEFAULT_INTERVAL;
+  }
+
+  // A FIFO is reopened for each writer; anything else at the
+  // path has to be a socket we may replace
+  struct stat st;
+  int exists = stat(plan->path, &st) == 0;
+  if (exists && S_ISFIFO(st.st_mode)) {
+    d->listen_fd = -1;
+  } else if (exists && !S_ISSOCK(st.st_mode)) {
+    fprintf(stderr, "%s is neither a FIFO nor a socket\n", plan->path);
+    return 0;
+  } else if ((d->listen_fd = listen_socket(plan->path)) < 0) {
+    return 0;
+  }
+
+  // The ring covers the longest window, in whole words
+  uint32_t longest = 64;
+  for (int w = 0; w < d->plan.numWindows; w++) {
+    if (d->plan.windows[w] > longest) {
+      longest = d->plan.windows[w];
+    }
+  }
+  uint64_t size = 64;
+  while (size < longest) {
+    size <<= 1;
+  }
+  d->mask = size - 1;
+  d->ring = (uint64_t*)calloc(size / 64, sizeof(uint64_t));
+
+  // Both only raise flags. Waits for input happen in ppoll,
+  // which a signal always interrupts; anything else blocked,
+  // such as a write of a report, is restarted
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sa.sa_handler = on_timer;
+  sigaction(SIGALRM, &sa, NULL);
+
+  struct itimerval it;
+  it.it_interval.tv_sec = d->plan.interval / 1000;
+  it.it_interval.tv_usec = (d->plan.interval % 1000) * 1000;
+  it.it_value = it.it_interval;
+  setitimer(ITIMER_REAL, &it, NULL);
+
+  d->start_ns = now_ns();
+  return 1;
+}
+
+int
+daemon_wait(void *arg, int fd)
+{
+  daemon_state *d = (daemon_state*)arg;
+  struct pollfd p = { fd, POLLIN, 0 };
+  sigset_t block, unblocked;
+  sigemptyset(&block);
+  sigaddset(&block, SIGALRM);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+
+  // The flags are checked with the signals held off, and ppoll
+  // lets them in only while it waits, so none slips past
+  sigprocmask(SIG_BLOCK, &block, &unblocked);
+  int ready = 0;
+  while (!stopping && !ready) {
+    if (daemonReportDue) {
+      daemon_report(d);
+      continue;
+    }
+    int n = ppoll(&p, 1, NULL, &unblocked);
+    if (n < 0 && errno != EINTR) {
+      perror(d->plan.path);
+      break;
+    }
+    ready = n > 0;
+  }
+  sigprocmask(SIG_SETMASK, &unblocked, NULL);
+  return ready;
+}
+
+int
+daemon_accept(daemon_state *d)
+{
+  int fd;
+  if (d->listen_fd >= 0) {
+    if (!daemon_wait(d, d->listen_fd)) {
+      return -1;
+    }
+    if ((fd = accept(d->listen_fd, NULL, NULL)) < 0) {
+      perror(d->plan.path);
+      return -1;
+    }
+  } else {
+    // Opened without waiting for a writer, a FIFO polls
+    // readable once one has written or come and gone
+    if ((fd = open(d->plan.path, O_RDONLY | O_NONBLOCK)) < 0) {
+      perror(d->plan.path);
+      return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    if (!daemon_wait(d, fd)) {
+      close(fd);
+      return -1;
+    }
+  }
+  d->feeds++;
+  return fd;
+}
+
+int
+daemon_stopping()
+{
+  return stopping;
+}
+
+void
+daemon_report(daemon_state *d)
+{
+  FILE *out = d->out;
+  daemonReportDue = 0;
+  fprintf(out, "elapsed=%.3f feeds=%d branches=%llu rate=%.3f",
+          (now_ns() - d->start_ns) / 1e9, d->feeds, (unsigned long long)d->branches,
+          d->branches ? 100.0 * d->mispredictions / d->branches : 0.0);
+
+  // Until a window has filled, its rate is over what there is
+  for (int w = 0; w < d->plan.numWindows; w++) {
+    uint64_t n = d->branches < d->plan.windows[w] ? d->branches : d->plan.windows[w];
+    fprintf(out, " w%u=%.3f", d->plan.windows[w],
+            n ? 100.0 * d->window_miss[w] / n : 0.0);
+  }
+  fprintf(out, "\n");
+  fflush(out);
+}
+
+void
+daemon_close(daemon_state *d)
+{
+  struct itimerval it;
+  memset(&it, 0, sizeof(it));
+  setitimer(ITIMER_REAL, &it, NULL);
+  if (d->listen_fd >= 0) {
+    close(d->listen_fd);
+    unlink(d->plan.path);
+  }
+  free(d->ring);
+}
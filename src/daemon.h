@@ -0,0 +1,113 @@
+//========================================================//
+//  daemon.h                                              //
+//  Header file for the streaming daemon mode             //
+//                                                        //
+//  The predictor stays up between writers: branches come //
+//  in on a FIFO or a Unix domain socket, one writer at a //
+//  time, and the misprediction rates over the last few   //
+//  windows of branches are reported at fixed intervals   //
+//========================================================//
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define DAEMON_MAX_WINDOWS       8
+#define DAEMON_MAX_WINDOW        (1u << 26) // branches, so the ring is at most 8MB
+#define DAEMON_DEFAULT_INTERVAL  1000       // ms between reports
+
+typedef struct daemon_plan {
+  const char *path;    // an existing FIFO, else a socket to create
+  uint32_t windows[DAEMON_MAX_WINDOWS];
+  int numWindows;      // 0: the defaults
+  uint32_t interval;   // ms, 0: the default
+} daemon_plan;
+
+typedef struct daemon_state {
+  daemon_plan plan;
+  FILE *out;           // reports
+  int listen_fd;       // -1 when reading a FIFO
+  int feeds;
+  uint64_t start_ns;
+
+  // Misprediction bits of the last 'mask + 1' branches, and
+  // how many are set within each window
+  uint64_t *ring;
+  uint64_t mask;
+  uint64_t branches;
+  uint64_t mispredictions;
+  uint32_t window_miss[DAEMON_MAX_WINDOWS];
+} daemon_state;
+
+// Set by the interval timer when a report is due, and by a
+// stop, which daemon_stopping tells apart
+extern volatile sig_atomic_t daemonReportDue;
+
+// Parse "<n>[,<n>...]" window sizes, in branches, into 'plan'
+//
+// Returns True if Successful
+//
+int daemon_parse_windows(const char *spec, daemon_plan *plan);
+
+// Take over 'plan->path' and start the report timer, reporting
+// to 'out'; SIGINT and SIGTERM from then on stop the daemon
+//
+// Returns True if Successful
+//
+int daemon_open(daemon_state *d, const daemon_plan *plan, FILE *out);
+
+// Wait for input on 'fd', reporting while it is idle (a
+// trace_open_live wait function, on a daemon_state)
+//
+// Returns True once 'fd' is readable, False once the daemon is
+// stopping
+//
+int daemon_wait(void *d, int fd);
+
+// Wait for the next writer, reporting meanwhile
+//
+// Returns the descriptor to read its branches from, or -1 once
+// the daemon is stopping
+//
+int daemon_accept(daemon_state *d);
+
+// Returns True once SIGINT or SIGTERM has arrived
+//
+int daemon_stopping(void);
+
+// Count one branch into the windows
+//
+static inline void
+daemon_record(daemon_state *d, int miss)
+{
+  uint64_t i = d->branches++;
+  uint64_t *word = &d->ring[(i & d->mask) >> 6];
+  uint64_t bit = (uint64_t)1 << (i & 63);
+
+  // The oldest bits are read before the newest overwrites one,
+  // so a window may be as long as the ring
+  for (int w = 0; w < d->plan.numWindows; w++) {
+    uint64_t window = d->plan.windows[w];
+    if (i >= window) {
+      uint64_t j = (i - window) & d->mask;
+      d->window_miss[w] -= (d->ring[j >> 6] >> (j & 63)) & 1;
+    }
+    d->window_miss[w] += miss;
+  }
+  *word = miss ? *word | bit : *word & ~bit;
+  d->mispredictions += miss;
+}
+
+// Print one report line: the elapsed time, the branches and
+// rate so far, and the rate over each window
+//
+void daemon_report(daemon_state *d);
+
+// Stop the timer, release the path and free the windows
+//
+void daemon_close(daemon_state *d);
+
+#endif
@@ -9,10 +9,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include "predictor.h"
+#include "trace.h"
+#include "sweep.h"
+#include "pool.h"
+#include "profile.h"
+#include "stats.h"
+#include "output.h"
+#include "autotune.h"
+#include "segment.h"
+#include "sample.h"
+#include "daemon.h"
+#include "window.h"
+#include "alias.h"
 
-FILE *stream;
-char *buf = NULL;
-size_t len = 0;
+trace_reader trace;
+const char *convertPath = NULL;
+int convertColumnar = 0;
+sweep_point sweepPoints[SWEEP_MAX_POINTS];
+int numSweepPoints = 0;
+int numJobs = -1;  // -1: single-pass sweep, 0: one worker per core
+int profileTop = 0; // > 0: report this many hardest branches
+int showStats = 0;
+int showTables = 0;
+int showAliasing = 0;
+int verboseMode = OUTPUT_TEXT;
+const char *verbosePath = NULL;  // NULL: stdout
+uint64_t autotuneBudget = 0;     // > 0: search geometries within this many bits
+const char *saveStatePath = NULL;
+uint64_t saveStateAt = 0;        // 0: at the end of the trace
+const char *loadStatePath = NULL;
+int numSegments = 0;             // > 0: simulate the trace in this many parallel segments
+uint64_t segmentWarmup = SEGMENT_DEFAULT_WARMUP;
+sample_plan samplePlan;          // period 0: measure every branch
+daemon_plan daemonPlan;          // path NULL: simulate a trace
+uint64_t windowSize = 0;         // > 0: write statistics per window of this many branches
+const char *windowPath = NULL;
+double phaseThreshold = WINDOW_DEFAULT_THRESHOLD;
 
 // Print out the Usage information to stderr
 //
@@ -20,15 +52,75 @@ void
 usage()
 {
   fprintf(stderr,"Usage: predictor <options> [<trace>]\n");
+  fprintf(stderr,"       predictor --sweep:<type>[,<type>...] [--jobs:<n>] <trace>...\n");
   fprintf(stderr,"       bunzip -kc trace.bz2 | predictor <options>\n");
+  fprintf(stderr," <trace> may be text, binary (see --convert) or bzip2 compressed\n");
   fprintf(stderr," Options:\n");
   fprintf(stderr," --help       Print this message\n");
   fprintf(stderr," --verbose    Print predictions on stdout\n");
+  fprintf(stderr," --verbose:<format>[:<file>]\n"
+                 "              Write predictions as text, bits (one bit per branch) or\n"
+                 "              mismatch (run lengths between mispredictions); bits and\n"
+                 "              mismatch need a <file>\n");
+  fprintf(stderr," --convert:<file>[:columnar]\n"
+                 "              Write the trace to <file> in binary format, or in the\n"
+                 "              compressed columnar format, and exit\n");
+  fprintf(stderr," --sweep:<type>[,<type>...]\n"
+                 "              Simulate every listed scheme in one pass over the trace\n");
+  fprintf(stderr," --profile[:<n>]\n"
+                 "              Report the <n> PCs with the most mispredictions (default %d)\n",
+                 PROFILE_DEFAULT_TOP);
+  fprintf(stderr," --stats      Report time per phase, throughput and peak memory\n");
+  fprintf(stderr," --tables     Report the bytes and page kind of each predictor table\n");
+  fprintf(stderr," --aliasing   Report how gshare or tournament table entries are shared\n"
+                 "              between PCs and whether that helps or hurts predictions\n");
+  fprintf(stderr," --save-state:<file>[:<n>]\n"
+                 "              Snapshot the predictor to <file> after <n> branches\n"
+                 "              (default: at the end of the trace)\n");
+  fprintf(stderr," --load-state:<file>\n"
+                 "              Resume from a snapshot: restore the predictor and skip\n"
+                 "              the branches it had already seen\n");
+  fprintf(stderr," --autotune:<bits>\n"
+                 "              Find the most accurate geometries of each scheme that fit\n"
+                 "              in <bits> of storage over all given traces\n");
+  fprintf(stderr," --segments:<n>[:<warmup>]\n"
+                 "              Split the trace into <n> segments simulated in parallel,\n"
+                 "              each trained first on the <warmup> branches before it\n"
+                 "              (default %d), and estimate the error against a serial run\n",
+                 SEGMENT_DEFAULT_WARMUP);
+  fprintf(stderr," --sample:<period>:<interval>[:<warmup>]\n"
+                 "              Measure only <interval> branches out of every <period>\n"
+                 "              and report the rate with a 95%% confidence interval\n");
+  fprintf(stderr," --sample-warming:<mode>\n"
+                 "              Between samples train the tables (functional, default)\n"
+                 "              or only shift the histories (history), then train\n"
+                 "              over <warmup> branches (default one interval)\n");
+  fprintf(stderr," --windows:<n>:<file>\n"
+                 "              Write the mispredictions, distinct PCs, taken ratio and\n"
+                 "              program phase of every <n> branches to <file> as CSV\n");
+  fprintf(stderr," --phase-threshold:<d>\n"
+                 "              Start a new phase when a window's code signature is\n"
+                 "              more than <d> (0 - 2) from every known one (default %.1f)\n",
+                 WINDOW_DEFAULT_THRESHOLD);
+  fprintf(stderr," --daemon:<path>\n"
+                 "              Keep the predictor running on branches fed, text or\n"
+                 "              binary, by one writer at a time to the FIFO at <path>,\n"
+                 "              else to a Unix domain socket created there, until\n"
+                 "              SIGINT or SIGTERM\n");
+  fprintf(stderr," --daemon-windows:<n>[,<n>...]\n"
+                 "              Report the rates over the last <n> branches (default\n"
+                 "              10000,100000,1000000)\n");
+  fprintf(stderr," --daemon-interval:<ms>\n"
+                 "              Report every <ms> milliseconds (default %d)\n",
+                 DAEMON_DEFAULT_INTERVAL);
+  fprintf(stderr," --jobs:<n>   Run a sweep, autotune or segmented run on <n>\n"
+                 "              threads (0 = one per core)\n");
   fprintf(stderr," --<type>     Branch prediction scheme:\n");
   fprintf(stderr,"    static\n"
                  "    gshare:<# ghistory>\n"
                  "    tournament:<# ghistory>:<# lhistory>:<# index>\n"
-                 "    custom\n");
+                 "    custom:<# base history>\n"
+                 "    perceptron:<history length>:<# perceptrons>\n");
 }
 
 
@@ -40,16 +132,110 @@ usage()
 int
 handle_option(char *arg)
 {
-  if (!strcmp(arg,"--static")) {
-    bpType = STATIC;
-  } else if (!strncmp(arg,"--gshare",8)) {
-    bpType = GSHARE;
-  } else if (!strncmp(arg,"--tournament",12)) {
-    bpType = TOURNAMENT;
-  } else if (!strncmp(arg,"--custom",8)) {
-    bpType = CUSTOM;
+  if (!strcmp(arg,"--static") || !strncmp(arg,"--gshare",8) ||
+      !strncmp(arg,"--tournament",12) || !strncmp(arg,"--custom",8) ||
+      !strncmp(arg,"--perceptron",12)) {
+    // omitted parameters keep their defaults
+    bp_config cfg;
+    if (!bp_parse_config(arg + 2, &cfg)) {
+      return 0;
+    }
+    bpType = cfg.bpType;
+    ghistoryBits = cfg.ghistoryBits;
+    tour_historyBits = cfg.tour_historyBits;
+    lhistoryBits = cfg.lhistoryBits;
+    pcIndexBits = cfg.pcIndexBits;
+    perceptronHistory = cfg.perc_historyLen;
+    perceptronEntries = cfg.perc_entries;
   } else if (!strcmp(arg,"--verbose")) {
     verbose = 1;
+  } else if (!strncmp(arg,"--verbose:",10)) {
+    char *sep = strchr(arg + 10, ':');
+    if (sep) {
+      *sep = 0;
+      verbosePath = sep + 1;
+    }
+    verbose = 1;
+    verboseMode = output_mode(arg + 10);
+    if (verboseMode < 0) {
+      return 0;
+    }
+    // binary formats need a file, on stdout they would run
+    // into the summary
+    return verboseMode == OUTPUT_TEXT || (verbosePath && *verbosePath);
+  } else if (!strncmp(arg,"--convert:",10) && arg[10]) {
+    char *sep = strrchr(arg + 10, ':');
+    if (sep && !strcmp(sep, ":columnar")) {
+      *sep = 0;
+      convertColumnar = 1;
+    }
+    convertPath = arg + 10;
+  } else if (!strncmp(arg,"--sweep:",8)) {
+    numSweepPoints = sweep_parse(arg + 8, sweepPoints, SWEEP_MAX_POINTS);
+    return numSweepPoints > 0;
+  } else if (!strcmp(arg,"--stats")) {
+    showStats = 1;
+  } else if (!strcmp(arg,"--tables")) {
+    showTables = 1;
+  } else if (!strcmp(arg,"--aliasing")) {
+    showAliasing = 1;
+  } else if (!strcmp(arg,"--profile")) {
+    profileTop = PROFILE_DEFAULT_TOP;
+  } else if (!strncmp(arg,"--profile:",10)) {
+    profileTop = atoi(arg + 10);
+    return profileTop > 0;
+  } else if (!strncmp(arg,"--save-state:",13) && arg[13]) {
+    char *sep = strchr(arg + 13, ':');
+    saveStatePath = arg + 13;
+    if (sep) {
+      char *end;
+      *sep = 0;
+      saveStateAt = strtoull(sep + 1, &end, 10);
+      return end != sep + 1 && !*end && saveStateAt > 0;
+    }
+  } else if (!strncmp(arg,"--load-state:",13) && arg[13]) {
+    loadStatePath = arg + 13;
+  } else if (!strncmp(arg,"--autotune:",11)) {
+    char *end;
+    autotuneBudget = strtoull(arg + 11, &end, 10);
+    return end != arg + 11 && !*end && autotuneBudget > 0;
+  } else if (!strncmp(arg,"--segments:",11)) {
+    char *end;
+    numSegments = (int)strtol(arg + 11, &end, 10);
+    if (*end == ':') {
+      char *warmup = end + 1;
+      segmentWarmup = strtoull(warmup, &end, 10);
+      if (end == warmup) {
+        return 0;
+      }
+    }
+    return end != arg + 11 && !*end && numSegments > 0;
+  } else if (!strncmp(arg,"--sample:",9)) {
+    return sample_parse(arg + 9, &samplePlan);
+  } else if (!strncmp(arg,"--sample-warming:",17)) {
+    samplePlan.warming = sample_warming(arg + 17);
+    return samplePlan.warming >= 0;
+  } else if (!strncmp(arg,"--windows:",10)) {
+    char *end;
+    windowSize = strtoull(arg + 10, &end, 10);
+    windowPath = end + 1;
+    return end != arg + 10 && *end == ':' && *windowPath && windowSize > 0;
+  } else if (!strncmp(arg,"--phase-threshold:",18)) {
+    char *end;
+    phaseThreshold = strtod(arg + 18, &end);
+    return end != arg + 18 && !*end && phaseThreshold >= 0;
+  } else if (!strncmp(arg,"--daemon:",9)) {
+    daemonPlan.path = arg + 9;
+    return *daemonPlan.path != 0;
+  } else if (!strncmp(arg,"--daemon-windows:",17)) {
+    return daemon_parse_windows(arg + 17, &daemonPlan);
+  } else if (!strncmp(arg,"--daemon-interval:",18)) {
+    char *end;
+    daemonPlan.interval = strtoul(arg + 18, &end, 10);
+    return end != arg + 18 && !*end && daemonPlan.interval > 0;
+  } else if (!strncmp(arg,"--jobs:",7)) {
+    numJobs = atoi(arg + 7);
+    return numJobs >= 0;
   } else {
     return 0;
   }
@@ -57,22 +243,101 @@ handle_option(char *arg)
   return 1;
 }
 
-// Reads a line from the input stream and extracts the
-// PC and Outcome of a branch
+// Reads the next branch from the trace (text, binary or bzip2)
+// and extracts the PC and Outcome of a branch
 //
 // Returns True if Successful 
 //
 int
 read_branch(uint32_t *pc, uint8_t *outcome)
 {
-  if (getline(&buf, &len, stream) == -1) {
-    return 0;
+  return trace_read(&trace, pc, outcome);
+}
+
+// Run the predictor over the trace measuring only the sample
+// intervals of 'plan'; a trailing incomplete sample is dropped
+//
+// Returns the number of branches in the trace
+//
+uint64_t
+run_sampled(const sample_plan *plan, sample_stats *stats)
+{
+  uint64_t skip = plan->period - plan->warmup - plan->interval;
+  uint64_t branches = 0;
+  uint32_t pc = 0;
+  uint8_t outcome = NOTTAKEN;
+  uint64_t i;
+
+  for (;;) {
+    if (plan->warming == SAMPLE_HISTORY) {
+      for (i = 0; i < skip && read_branch(&pc, &outcome); i++) {
+        fast_forward_predictor(pc, outcome);
+      }
+      branches += i;
+      if (i < skip) {
+        break;
+      }
+    }
+
+    // Functional warming trains on everything up to the sample
+    uint64_t warm = plan->warming == SAMPLE_HISTORY ? plan->warmup : skip + plan->warmup;
+    for (i = 0; i < warm && read_branch(&pc, &outcome); i++) {
+      train_predictor(pc, outcome);
+    }
+    branches += i;
+    if (i < warm) {
+      break;
+    }
+
+    uint32_t mispredictions = 0;
+    for (i = 0; i < plan->interval && read_branch(&pc, &outcome); i++) {
+      mispredictions += make_prediction(pc) != outcome;
+      train_predictor(pc, outcome);
+    }
+    branches += i;
+    if (i < plan->interval) {
+      break;
+    }
+    sample_add(stats, plan, mispredictions);
   }
 
-  uint32_t tmp;
-  sscanf(buf,"0x%x %d\n",pc,&tmp);
-  *outcome = tmp;
+  return branches;
+}
+
+// Serve the predictor to the writers of 'plan->path', one at
+// a time, reporting every interval until stopped
+//
+// Returns True if Successful
+//
+int
+run_daemon(const daemon_plan *plan)
+{
+  daemon_state d;
+  uint32_t pc = 0;
+  uint8_t outcome = NOTTAKEN;
+  int fd;
 
+  if (!daemon_open(&d, plan, stdout)) {
+    return 0;
+  }
+  init_predictor();
+  while ((fd = daemon_accept(&d)) >= 0) {
+    if (trace_open_live(&trace, fd, daemon_wait, &d)) {
+      while (read_branch(&pc, &outcome)) {
+        daemon_record(&d, make_prediction(pc) != outcome);
+        train_predictor(pc, outcome);
+        if (daemonReportDue) {
+          if (daemon_stopping()) {
+            break;
+          }
+          daemon_report(&d);
+        }
+      }
+    }
+    trace_close(&trace);
+  }
+  daemon_report(&d);
+  daemon_close(&d);
   return 1;
 }
 
@@ -80,7 +345,8 @@ int
 main(int argc, char *argv[])
 {
   // Set defaults
-  stream = stdin;
+  const char *tracePaths[SWEEP_MAX_TRACES];
+  int numTraces = 0;
   bpType = STATIC;
   verbose = 0;
 
@@ -97,33 +363,255 @@ main(int argc, char *argv[])
       }
     } else {
       // Use as input file
-      stream = fopen(argv[i], "r");
+      if (numTraces == SWEEP_MAX_TRACES) {
+        printf("Too many traces (max %d)\n", SWEEP_MAX_TRACES);
+        exit(1);
+      }
+      tracePaths[numTraces++] = argv[i];
     }
   }
 
-  // Initialize the predictor
-  init_predictor();
+  // The autotuner, like the parallel sweep, decodes each trace
+  // once into memory
+  if (autotuneBudget > 0) {
+    if (numTraces == 0) {
+      tracePaths[numTraces++] = NULL;
+    }
+    int threads = numJobs > 0 ? numJobs : pool_default_threads();
+    return autotune_run(tracePaths, numTraces, autotuneBudget, threads) ? 0 : 1;
+  }
+
+  // Sweeps over several traces (or with --jobs) run on the
+  // parallel engine, each trace decoded once into memory
+  if (numSweepPoints > 0 && (numTraces > 1 || numJobs >= 0)) {
+    if (numTraces == 0) {
+      tracePaths[numTraces++] = NULL;
+    }
+    int threads = numJobs > 0 ? numJobs : pool_default_threads();
+    sweep_point *results = (sweep_point*)malloc(numTraces * numSweepPoints * sizeof(sweep_point));
+    int ok = sweep_run_parallel(tracePaths, numTraces, sweepPoints, numSweepPoints,
+                                threads, results);
+    if (ok) {
+      sweep_print_matrix(tracePaths, numTraces, sweepPoints, numSweepPoints, results);
+    }
+    free(results);
+    return ok ? 0 : 1;
+  }
+  if (numTraces > 1) {
+    printf("Multiple traces are only supported with --sweep or --autotune\n");
+    usage();
+    exit(1);
+  }
+
+  // A segmented run decodes the trace into memory and cuts it up
+  if (numSegments > 0) {
+    bp_config cfg;
+    segment_result res;
+    int threads = numJobs > 0 ? numJobs : pool_default_threads();
+    bp_default_config(&cfg, bpType);
+    if (!segment_run(numTraces ? tracePaths[0] : NULL, &cfg, numSegments,
+                     segmentWarmup, threads, &res)) {
+      exit(1);
+    }
+    segment_report(&res, stdout);
+    return 0;
+  }
+
+  // A daemon reads its branches from writers instead
+  if (daemonPlan.path) {
+    if (numTraces > 0) {
+      printf("A daemon takes no trace\n");
+      usage();
+      exit(1);
+    }
+    return run_daemon(&daemonPlan) ? 0 : 1;
+  }
+
+  // Open the trace, detecting its format from the header
+  if (!trace_open(&trace, numTraces ? tracePaths[0] : NULL)) {
+    exit(1);
+  }
+
+  // Conversion only rewrites the trace, no simulation
+  if (convertPath) {
+    int64_t converted = convertColumnar ? trace_convert_columnar(&trace, convertPath)
+                                        : trace_convert(&trace, convertPath);
+    trace_close(&trace);
+    if (converted < 0) {
+      exit(1);
+    }
+    printf("Converted %lld branches to %s\n", (long long)converted, convertPath);
+    return 0;
+  }
+
+  // A sweep replaces the single predictor run
+  if (numSweepPoints > 0) {
+    sweep_run(&trace, sweepPoints, numSweepPoints);
+    sweep_print(sweepPoints, numSweepPoints);
+    trace_close(&trace);
+    return 0;
+  }
+
+  // A sampled run measures only part of the trace
+  if (samplePlan.period > 0) {
+    sample_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    init_predictor();
+    uint64_t branches = run_sampled(&samplePlan, &stats);
+    trace_close(&trace);
+    sample_report(&stats, &samplePlan, branches, stdout);
+    return 0;
+  }
+
+  // Initialize the predictor, or restore a warmed one and pick
+  // up the trace where its snapshot was taken
+  uint64_t resumed = 0;
+  if (loadStatePath) {
+    if (!load_predictor(loadStatePath, &resumed)) {
+      exit(1);
+    }
+    uint64_t skipped = trace_skip(&trace, resumed);
+    printf("Resumed %s predictor from %s after %llu branches\n", bpName[bpType],
+           loadStatePath, (unsigned long long)skipped);
+  } else {
+    init_predictor();
+  }
+  profile *prof = profileTop > 0 ? profile_create() : NULL;
+  bp_access accesses[BP_MAX_ACCESSES];
+  alias_analysis *alias = NULL;
+  if (showAliasing && !(alias = alias_create(accesses, predictor_accesses(0, accesses)))) {
+    exit(1);
+  }
+  window_series series;
+  window_series *windows = NULL;
+  if (windowSize > 0) {
+    if (!window_open(&series, windowSize, phaseThreshold, windowPath)) {
+      exit(1);
+    }
+    windows = &series;
+  }
+  pred_output predictions;
+  if (verbose && !output_open(&predictions, verboseMode, verbosePath)) {
+    exit(1);
+  }
 
   uint32_t num_branches = 0;
   uint32_t mispredictions = 0;
   uint32_t pc = 0;
   uint8_t outcome = NOTTAKEN;
 
+  // With --stats, sampled branches are timed from the start
+  // of their read to the end of their training
+  run_stats stats;
+  uint64_t t_read = 0, t_predict = 0, t_train = 0, wait_read = 0;
+  if (showStats) {
+    stats_start(&stats);
+  }
+
+  // When nothing looks at single branches, hand the predictor
+  // whole batches so it can look ahead; the loop below then
+  // finds the trace drained. With --stats, whole batches are
+  // timed, so the default run is what gets measured; with
+  // --verbose, the batch's predictions are written together
+  if (!prof && !alias && saveStateAt == 0) {
+    trace_batch batch;
+    uint8_t batch_prediction[TRACE_BATCH];
+    uint8_t *prediction = verbose ? batch_prediction : NULL;
+    uint64_t t_batch = showStats ? stats_ticks() : 0;
+    while (trace_read_batch(&trace, &batch)) {
+      uint64_t t_simulate = showStats ? stats_ticks() : 0;
+      if (!windows) {
+        mispredictions += simulate_predictor(batch.pc, batch.outcome, prediction, batch.n);
+      } else {
+        // Batches are cut at window boundaries
+        for (int i = 0, n; i < batch.n; i += n) {
+          n = window_room(windows, batch.n - i);
+          uint32_t missed = simulate_predictor(batch.pc + i, batch.outcome + i,
+                                               prediction ? prediction + i : NULL, n);
+          window_add(windows, batch.pc + i, batch.outcome + i, n, missed);
+          mispredictions += missed;
+        }
+      }
+      if (verbose) {
+        output_put_batch(&predictions, prediction, batch.outcome, batch.n);
+      }
+      if (showStats) {
+        uint64_t now = stats_ticks();
+        stats_sample_batch(&stats, t_batch, t_simulate, now, batch.n,
+                           trace.wait_ticks - wait_read);
+        if (num_branches / STATS_BATCH != (num_branches + batch.n) / STATS_BATCH) {
+          stats_batch(&stats);
+        }
+        wait_read = trace.wait_ticks;
+        t_batch = now;
+      }
+      num_branches += batch.n;
+    }
+  }
+
   // Reach each branch from the trace
   while (read_branch(&pc, &outcome)) {
     num_branches++;
+    int sampled = showStats && stats_sampled(&stats, num_branches);
+    if (sampled) {
+      t_predict = stats_ticks();
+    }
 
     // Make a prediction and compare with actual outcome
     uint8_t prediction = make_prediction(pc);
+    if (sampled) {
+      t_train = stats_ticks();
+    }
     if (prediction != outcome) {
       mispredictions++;
     }
     if (verbose != 0) {
-      printf ("%d\n", prediction);
+      output_put(&predictions, prediction, outcome);
+    }
+    if (prof) {
+      profile_record(prof, pc, outcome, prediction);
+    }
+    if (windows) {
+      window_record(windows, pc, outcome, prediction);
+    }
+    if (alias) {
+      alias_record(alias, pc, outcome, accesses, predictor_accesses(pc, accesses));
     }
 
     // Train the predictor
     train_predictor(pc, outcome);
+
+    if (saveStatePath && resumed + num_branches == saveStateAt) {
+      if (!save_predictor(saveStateAt, saveStatePath)) {
+        exit(1);
+      }
+    }
+
+    if (sampled) {
+      stats_sample(&stats, t_read, t_predict, t_train, stats_ticks(),
+                   trace.wait_ticks - wait_read);
+    }
+    if (showStats) {
+      if ((num_branches & (STATS_BATCH - 1)) == 0) {
+        stats_batch(&stats);
+      }
+      if (stats_sampled(&stats, num_branches + 1)) {
+        wait_read = trace.wait_ticks;
+        t_read = stats_ticks();
+      }
+    }
+  }
+
+  if (verbose && !output_close(&predictions)) {
+    exit(1);
+  }
+  if (windows && !window_close(windows)) {
+    exit(1);
+  }
+  if (saveStatePath && saveStateAt == 0) {
+    if (!save_predictor(resumed + num_branches, saveStatePath)) {
+      exit(1);
+    }
   }
 
   // Print out the mispredict statistics
@@ -131,10 +619,27 @@ main(int argc, char *argv[])
   printf("Incorrect:       %10d\n", mispredictions);
   float mispredict_rate = 100*((float)mispredictions / (float)num_branches);
   printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+  if (showStats) {
+    stats_finish(&stats, num_branches, trace.wait_ticks);
+    stats_report(&stats, stdout);
+  }
+  if (prof) {
+    profile_report(prof, profileTop, stdout);
+    profile_destroy(prof);
+  }
+  if (windows) {
+    window_report(windows, stdout);
+  }
+  if (alias) {
+    alias_report(alias, stdout);
+    alias_destroy(alias);
+  }
+  if (showTables) {
+    report_predictor_tables(stdout);
+  }
 
   // Cleanup
-  fclose(stream);
-  free(buf);
+  trace_close(&trace);
 
   return 0;
 }
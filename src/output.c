@@ -0,0 +1,78 @@
+//========================================================//
+//  output.c                                              //
+//  Source file for the --verbose prediction stream       //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include "output.h"
+
+int
+output_mode(const char *name)
+{
+  if (!strcmp(name, "text")) {
+    return OUTPUT_TEXT;
+  } else if (!strcmp(name, "bits")) {
+    return OUTPUT_BITS;
+  } else if (!strcmp(name, "mismatch")) {
+    return OUTPUT_MISMATCH;
+  }
+  return -1;
+}
+
+int
+output_open(pred_output *o, int mode, const char *path)
+{
+  memset(o, 0, sizeof(*o));
+  o->mode = mode;
+  if (path) {
+    o->out = fopen(path, mode == OUTPUT_TEXT ? "w" : "wb");
+    if (!o->out) {
+      perror(path);
+      return 0;
+    }
+  } else {
+    o->out = stdout;
+  }
+  o->buf = (uint8_t*)malloc(OUTPUT_BUFFER + OUTPUT_SLACK);
+  return 1;
+}
+
+void
+output_flush(pred_output *o)
+{
+  fwrite(o->buf, 1, o->len, o->out);
+  o->len = 0;
+}
+
+void
+output_put_batch(pred_output *o, const uint8_t *prediction, const uint8_t *outcome, int n)
+{
+  for (int i = 0; i < n; i++) {
+    output_put(o, prediction[i], outcome[i]);
+  }
+}
+
+int
+output_close(pred_output *o)
+{
+  int ok;
+
+  // a partly filled byte of bits goes out padded
+  if (o->mode == OUTPUT_BITS && o->nbits > 0) {
+    o->buf[o->len++] = o->bits;
+  }
+  output_flush(o);
+
+  if (o->out == stdout) {
+    ok = fflush(stdout) == 0;
+  } else {
+    ok = fclose(o->out) == 0;
+  }
+  if (!ok) {
+    perror("prediction output");
+  }
+  free(o->buf);
+  memset(o, 0, sizeof(*o));
+  return ok;
+}
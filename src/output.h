@@ -0,0 +1,110 @@
+//========================================================//
+//  output.h                                              //
+//  Header file for the --verbose prediction stream       //
+//                                                        //
+//  Predictions are collected in a large buffer and       //
+//  written out in bulk, as text (one "0"/"1" line per    //
+//  branch), as packed bits or as the run lengths between //
+//  mispredictions                                        //
+//========================================================//
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//------------------------------------//
+//           Stream Formats           //
+//------------------------------------//
+//
+// OUTPUT_TEXT      "<prediction>\n" per branch, as printed
+//                  by --verbose before
+// OUTPUT_BITS      one bit per branch, branch i in bit i % 8
+//                  (LSB first) of byte i / 8; the last byte
+//                  is padded with zeros
+// OUTPUT_MISMATCH  for each misprediction, the number of
+//                  correct predictions since the previous one
+//                  as an unsigned LEB128 varint; correct
+//                  predictions after the last misprediction
+//                  are not written
+//
+#define OUTPUT_TEXT      0
+#define OUTPUT_BITS      1
+#define OUTPUT_MISMATCH  2
+
+#define OUTPUT_BUFFER  (1 << 20)
+#define OUTPUT_SLACK   16  // room for one record past the flush mark
+
+typedef struct pred_output {
+  FILE *out;
+  int mode;
+  uint8_t *buf;
+  size_t len;
+  uint8_t bits;     // OUTPUT_BITS: bits of the byte being filled
+  int nbits;
+  uint64_t run;     // OUTPUT_MISMATCH: correct predictions so far
+} pred_output;
+
+// Mode named by 'name' ("text", "bits" or "mismatch")
+//
+// Returns the mode, or -1 if the name is unknown
+//
+int output_mode(const char *name);
+
+// Start a stream in 'mode' to 'path' (stdout if NULL)
+//
+// Returns True if Successful
+//
+int output_open(pred_output *o, int mode, const char *path);
+
+// Write out the buffer
+//
+void output_flush(pred_output *o);
+
+// Record the prediction made for one branch
+//
+static inline void
+output_put(pred_output *o, uint8_t prediction, uint8_t outcome)
+{
+  switch (o->mode) {
+    case OUTPUT_TEXT:
+      o->buf[o->len] = '0' + prediction;
+      o->buf[o->len + 1] = '\n';
+      o->len += 2;
+      break;
+    case OUTPUT_BITS:
+      o->bits |= prediction << o->nbits;
+      if (++o->nbits == 8) {
+        o->buf[o->len++] = o->bits;
+        o->bits = 0;
+        o->nbits = 0;
+      }
+      break;
+    case OUTPUT_MISMATCH:
+      if (prediction == outcome) {
+        o->run++;
+        return;
+      }
+      do {
+        o->buf[o->len++] = (o->run & 0x7f) | (o->run > 0x7f ? 0x80 : 0);
+        o->run >>= 7;
+      } while (o->run);
+      break;
+  }
+  if (o->len >= OUTPUT_BUFFER) {
+    output_flush(o);
+  }
+}
+
+// Record the predictions made for 'n' consecutive branches
+//
+void output_put_batch(pred_output *o, const uint8_t *prediction, const uint8_t *outcome, int n);
+
+// Write out everything recorded and close the stream
+//
+// Returns True if Successful
+//
+int output_close(pred_output *o);
+
+#endif
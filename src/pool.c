@@ -0,0 +1,231 @@
+//========================================================//
+//  pool.c                                                //
+//  Source file for the work-stealing thread pool         //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+
+typedef struct pool_task {
+  pool_fn fn;
+  void *arg;
+} pool_task;
+
+// Growable ring of tasks; the owner pushes and pops at the
+// bottom, thieves take from the top
+typedef struct pool_deque {
+  pthread_mutex_t lock;
+  pool_task *tasks;
+  unsigned cap;
+  unsigned top;
+  unsigned bottom;
+} pool_deque;
+
+typedef struct pool_worker {
+  pool *p;
+  int id;
+  pthread_t thread;
+  pool_deque deque;
+} pool_worker;
+
+struct pool {
+  int nthreads;
+  pool_worker *workers;
+  unsigned next;        // round-robin target for external submits
+
+  pthread_mutex_t lock; // guards the sleep/wake state below
+  pthread_cond_t work;  // signalled when tasks are queued
+  pthread_cond_t idle;  // signalled when pending drops to 0
+  int queued;           // tasks sitting in deques
+  int pending;          // tasks queued or running
+  int shutdown;
+};
+
+// Worker index of the calling thread, -1 outside the pool
+static __thread int pool_self = -1;
+
+int
+pool_default_threads()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+static void
+deque_push(pool_deque *d, pool_task task)
+{
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom - d->top == d->cap) {
+    unsigned cap = d->cap ? 2 * d->cap : 64;
+    pool_task *tasks = (pool_task*)malloc(cap * sizeof(pool_task));
+    for (unsigned i = d->top; i != d->bottom; i++) {
+      tasks[i & (cap - 1)] = d->tasks[i & (d->cap - 1)];
+    }
+    free(d->tasks);
+    d->tasks = tasks;
+    d->cap = cap;
+  }
+  d->tasks[d->bottom++ & (d->cap - 1)] = task;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static int
+deque_pop(pool_deque *d, pool_task *task)
+{
+  int found = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom != d->top) {
+    *task = d->tasks[--d->bottom & (d->cap - 1)];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+static int
+deque_steal(pool_deque *d, pool_task *task)
+{
+  int found = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom != d->top) {
+    *task = d->tasks[d->top++ & (d->cap - 1)];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+// Take a task from our own deque, else steal one
+//
+static int
+find_task(pool *p, int self, pool_task *task)
+{
+  if (deque_pop(&p->workers[self].deque, task)) {
+    return 1;
+  }
+  for (int i = 1; i < p->nthreads; i++) {
+    int victim = (self + i) % p->nthreads;
+    if (deque_steal(&p->workers[victim].deque, task)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *
+worker_main(void *arg)
+{
+  pool_worker *w = (pool_worker*)arg;
+  pool *p = w->p;
+  pool_task task;
+
+  pool_self = w->id;
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (p->queued == 0 && !p->shutdown) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (p->queued == 0 && p->shutdown) {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // Another worker may win the race for the last task
+    if (!find_task(p, w->id, &task)) {
+      continue;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->queued--;
+    pthread_mutex_unlock(&p->lock);
+
+    task.fn(task.arg);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->pending == 0) {
+      pthread_cond_broadcast(&p->idle);
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  return NULL;
+}
+
+pool *
+pool_create(int nthreads)
+{
+  pool *p = (pool*)calloc(1, sizeof(pool));
+  p->nthreads = nthreads > 0 ? nthreads : 1;
+  p->workers = (pool_worker*)calloc(p->nthreads, sizeof(pool_worker));
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->idle, NULL);
+
+  for (int i = 0; i < p->nthreads; i++) {
+    pool_worker *w = &p->workers[i];
+    w->p = p;
+    w->id = i;
+    pthread_mutex_init(&w->deque.lock, NULL);
+  }
+  for (int i = 0; i < p->nthreads; i++) {
+    pthread_create(&p->workers[i].thread, NULL, worker_main, &p->workers[i]);
+  }
+
+  return p;
+}
+
+void
+pool_submit(pool *p, pool_fn fn, void *arg)
+{
+  pool_task task = { fn, arg };
+  int target = pool_self;
+
+  pthread_mutex_lock(&p->lock);
+  p->pending++;
+  if (target < 0) {
+    target = p->next++ % p->nthreads;
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  deque_push(&p->workers[target].deque, task);
+
+  pthread_mutex_lock(&p->lock);
+  p->queued++;
+  pthread_cond_signal(&p->work);
+  pthread_mutex_unlock(&p->lock);
+}
+
+void
+pool_wait(pool *p)
+{
+  pthread_mutex_lock(&p->lock);
+  while (p->pending > 0) {
+    pthread_cond_wait(&p->idle, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+void
+pool_destroy(pool *p)
+{
+  pthread_mutex_lock(&p->lock);
+  p->shutdown = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->nthreads; i++) {
+    pthread_join(p->workers[i].thread, NULL);
+    pthread_mutex_destroy(&p->workers[i].deque.lock);
+    free(p->workers[i].deque.tasks);
+  }
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->work);
+  pthread_cond_destroy(&p->idle);
+  free(p->workers);
+  free(p);
+}
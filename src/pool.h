@@ -0,0 +1,38 @@
+//========================================================//
+//  pool.h                                                //
+//  Header file for the work-stealing thread pool         //
+//                                                        //
+//  Each worker owns a deque of tasks; it runs its own    //
+//  newest task first and steals the oldest task from     //
+//  another worker when its own deque runs dry            //
+//========================================================//
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef void (*pool_fn)(void *arg);
+
+typedef struct pool pool;
+
+// Number of online cores, used when no thread count is given
+//
+int pool_default_threads();
+
+// Start a pool with 'nthreads' workers
+//
+pool *pool_create(int nthreads);
+
+// Queue 'fn(arg)'; tasks may submit further tasks
+//
+void pool_submit(pool *p, pool_fn fn, void *arg);
+
+// Block until every submitted task (and the tasks they
+// submitted) has finished
+//
+void pool_wait(pool *p);
+
+// Stop the workers and free the pool
+//
+void pool_destroy(pool *p);
+
+#endif
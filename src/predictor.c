@@ -5,9 +5,19 @@
 //  Implement the various branch predictors below as      //
 //  described in the README                               //
 //========================================================//
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "predictor.h"
+#include "table.h"
+#include "counter.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PERC_X86 1
+#endif
 
 //
 // TODO:Student Information
@@ -55,11 +65,16 @@ void print_backward_binary(uint32_t input) {
 //------------------------------------//
 
 // Handy Global for use in output routines
-const char *bpName[4] = { "Static", "Gshare",
-                          "Tournament", "Custom" };
+const char *bpName[5] = { "Static", "Gshare",
+                          "Tournament", "Custom", "Perceptron" };
 
 //define number of bits required for indexing the BHT here. 
 int ghistoryBits = 14; // Number of bits used for Global History
+int tour_historyBits = 12; // Number of bits used for Tournament Global History
+int lhistoryBits = 11; // Number of bits used for Local History
+int pcIndexBits = 10;  // Number of bits used for PC index
+int perceptronHistory = 128; // Global history length of the perceptron
+int perceptronEntries = 256; // Number of perceptrons
 int bpType;       // Branch Prediction Type
 int verbose;
 
@@ -71,9 +86,9 @@ int verbose;
 //
 //TODO: Add your own Branch Predictor data structures here
 //
-//-------gshare------------
-uint8_t *bht_gshare;
-uint64_t ghistory;
+// Every table and history register lives in a bp_state, so any
+// number of predictors can be simulated side by side
+//
 
 //-------tournament--------
 // setting: 
@@ -89,43 +104,37 @@ uint64_t ghistory;
 // // choice part
 // #define TOUR_C_ENTRY 4 * 1024
 // uint8_t *tour_c_choice; // a table with TOUR_C_ENTRY entries, and each entry uses 2 bits
-int tour_historyBits = 12;
-int pcIndexBits = 10;
-int lhistoryBits = 11;
-#define TOUR_G_ENTRY my_pow2(tour_historyBits)
-uint8_t *tour_g_bht; // a table with TOUR_G_ENTRY entries, and each entry uses 2 bits
-uint64_t tour_g_history; // use only the last log2(TOUR_G_ENTRY) bits
-// local part
-#define TOUR_L_ENTRY my_pow2(pcIndexBits)
-#define TOUR_L_HISTORY lhistoryBits
-uint32_t *tour_l_history; // a table with TOUR_L_ENTRY entries (1K pc), and each entry uses TOUR_L_HISTORY bits for history
-uint8_t *tour_l_pattern; // a table with 2^TOUR_L_HISTORY entries, and each entry uses 2 bits
-// choice part
-#define TOUR_C_ENTRY my_pow2(tour_historyBits)
-uint8_t *tour_c_choice; // a table with TOUR_C_ENTRY entries, and each entry uses 2 bits
+#define TOUR_G_ENTRY(bp) my_pow2((bp)->cfg.tour_historyBits)
+#define TOUR_L_ENTRY(bp) my_pow2((bp)->cfg.pcIndexBits)
+#define TOUR_L_HISTORY(bp) ((bp)->cfg.lhistoryBits)
+#define TOUR_C_ENTRY(bp) my_pow2((bp)->cfg.tour_historyBits)
 
 
 //-------tage--------
 // design based on an article https://ssine.ink/en/posts/tage-predictor/
+// and Seznec's TAGE: a base predictor backed by tagged components
+// indexed with geometrically longer global histories. Histories are
+// folded incrementally (one shift/xor per component per branch), so
+// a prediction costs O(components) rather than O(history length)
 
 // base predictor part
 #define TAGE_BASE_ENTRY 4 * 1024
-uint8_t *tage_base_gshare;
-uint64_t tage_base_history;
 
 // tagged predictor part
 #define TAGE_COMP_NUM 5 // there are 5 components, and each component is a tagged predictor
 #define TAGE_TAG_LEN 10
-#define TAGE_COMP_ENTRY 256 // number of entries in each component
+#define TAGE_COMP_INDEX_BITS 8
+#define TAGE_COMP_ENTRY (1 << TAGE_COMP_INDEX_BITS) // number of entries in each component
+#define TAGE_CTR_BITS 3 // prediction counter of a tagged entry
+#define TAGE_U_BITS 2 // usefulness counter of a tagged entry
 const uint8_t TAGE_HISTORY_LEN[TAGE_COMP_NUM] = {80, 40, 20, 10, 5}; // the length of history used by each component is different
-#define TAGE_G_HISTORY_LEN 128
-
-uint8_t tage_g_history[TAGE_G_HISTORY_LEN]; // a very long history, and each component will use part of it
-uint32_t tage_l_history;
+#define TAGE_G_HISTORY_LEN 128 // power of 2, longer than any TAGE_HISTORY_LEN
+#define TAGE_U_RESET_PERIOD (256 * 1024) // branches between usefulness decays
+#define TAGE_USE_ALT_BITS 4 // confidence that fresh entries should defer to altpred
 
 typedef struct tage_comp_entry {
   uint16_t tag; // another hash of pc and history
-  uint8_t choice; // 2-bit state machine
+  uint8_t choice; // TAGE_CTR_BITS-bit state machine
   uint8_t usage; // whether this entry is useful
 } comp_entry;
 
@@ -134,306 +143,349 @@ typedef struct tage_comp {
   uint8_t len_history;
 } comp;
 
-comp tage_comp_list[TAGE_COMP_NUM];
-uint16_t tage_comp_entry_index[TAGE_COMP_NUM]; // store the entry index in tage_comp
+// A global history of 'len' bits folded down to 'width' bits by
+// xoring 'width'-bit chunks together, kept up to date as bits enter
+// and leave the history window
+typedef struct tage_fold {
+  uint32_t value;
+  uint8_t len;
+  uint8_t width;
+} tage_fold;
+
+
+//-------perceptron--------
+// Jimenez and Lin's perceptron: one vector of signed weights per
+// PC hash, dotted with the global history as +1/-1 per outcome.
+// Rows are padded to PERC_ALIGN weights so the dot product and
+// the update run whole vectors; pad weights stay 0
+#define PERC_ALIGN 32
+#define PERC_WEIGHT_MAX 127 // weights saturate symmetrically, -128 is never used
+#define PERC_THETA(h) ((int32_t)(1.93 * (h) + 14)) // training threshold
+#define perc_stride(h) (((h) + PERC_ALIGN - 1) & ~(PERC_ALIGN - 1))
+
+
+//-------predictor instance--------
+// Predict, train and simulate entry points of one scheme,
+// possibly specialised to one geometry (see Kernels below)
+typedef struct bp_kernel {
+  int bpType;
+  int bits[3]; // geometry of a specialised kernel, all 0 when generic
+  uint8_t (*predict)(bp_state *bp, uint32_t pc);
+  void (*train)(bp_state *bp, uint32_t pc, uint8_t outcome);
+  uint32_t (*simulate)(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+                       uint8_t *prediction, int n);
+} bp_kernel;
+
+// 2-bit counter tables are packed four entries per byte and
+// local histories at TOUR_L_HISTORY bits each (see table.h)
+struct bp_state {
+  bp_config cfg;
+  const bp_kernel *kernel;
+
+  // gshare
+  uint8_t *bht_gshare;
+  uint64_t ghistory;
+
+  // tournament global part
+  uint8_t *tour_g_bht; // a table with TOUR_G_ENTRY entries, and each entry uses 2 bits
+  uint64_t tour_g_history; // use only the last log2(TOUR_G_ENTRY) bits
+  // local part
+  uint64_t *tour_l_history; // a table with TOUR_L_ENTRY entries (1K pc), and each entry uses TOUR_L_HISTORY bits for history
+  uint8_t *tour_l_pattern; // a table with 2^TOUR_L_HISTORY entries, and each entry uses 2 bits
+  // choice part
+  uint8_t *tour_c_choice; // a table with TOUR_C_ENTRY entries, and each entry uses 2 bits
+
+  // tage base predictor part
+  uint8_t *tage_base_gshare;
+  uint64_t tage_base_history;
+  // tagged predictor part
+  uint64_t tage_g_history[TAGE_G_HISTORY_LEN / 64]; // circular bit-packed history, each component uses part of it
+  uint32_t tage_g_ptr; // slot of the newest history bit
+  tage_fold tage_index_fold[TAGE_COMP_NUM];
+  tage_fold tage_tag_fold[TAGE_COMP_NUM][2];
+  comp tage_comp_list[TAGE_COMP_NUM];
+  uint16_t tage_comp_entry_index[TAGE_COMP_NUM]; // store the entry index in tage_comp
+  uint16_t tage_comp_entry_tag[TAGE_COMP_NUM]; // and the tag it should carry
+  uint8_t tage_use_alt; // TAGE_USE_ALT_BITS-bit counter
+  uint32_t tage_tick; // branches since the last usefulness decay
+  uint32_t tage_seed; // pseudo-random allocation choice
+
+  // perceptron
+  int8_t *perc_weights; // perc_entries rows of perc_stride weights
+  int8_t *perc_bias;    // per row
+  int8_t *perc_history; // outcomes as +1/-1, see perceptron_push
+  int8_t *perc_mask;    // -1 on the real history lanes of a row, 0 on the pad
+  uint32_t perc_stride;
+  uint32_t perc_pos;    // newest history lane
+  int32_t perc_theta;
+};
+
+// Instance behind init_predictor/make_prediction/train_predictor
+bp_state *global_bp;
 
 //------------------------------------//
 //        Predictor Functions         //
 //------------------------------------//
 
+// The generic simulate loops look BP_PREFETCH_AHEAD branches
+// ahead and prefetch the table entries they will touch, once
+// a table outgrows the caches (BP_PREFETCH_MIN_BITS index bits,
+// 64KB of counters). The global history a later branch will see
+// is exact, shifted in from the outcomes in between
+#define BP_PREFETCH_AHEAD     16
+#define BP_PREFETCH_MIN_BITS  18
+
+// Score one prediction of a simulate loop, keeping it when the
+// caller passed a 'prediction' array
+static inline uint32_t
+simulate_miss(uint8_t *prediction, int i, uint8_t p, uint8_t outcome) {
+  if (prediction) {
+    prediction[i] = p;
+  }
+  return p != outcome;
+}
 
 
-// Initialize the predictor
-//
-
 //gshare functions
-void init_gshare() {
- int bht_entries = 1 << ghistoryBits;
-  bht_gshare = (uint8_t*)malloc(bht_entries * sizeof(uint8_t));
-  // unsigned long size_alloc = 0;
-  // size_alloc += bht_entries;
-  // printf("gshare predictor malloc used %lu entries, and each entry is 2 bit\n", size_alloc);
-  // printf("TEST: log2 of 4*1024 is %d\n", my_log2(4*1024));
-  // printf("TEST: 2^12 is %d\n", my_pow2(12));
-  int i = 0;
-  for(i = 0; i< bht_entries; i++){
-    bht_gshare[i] = WN;
-  }
-  ghistory = 0;
+void init_gshare(bp_state *bp) {
+ int bht_entries = 1 << bp->cfg.ghistoryBits;
+  bp->bht_gshare = ctr2_alloc(bht_entries, WN);
+  bp->ghistory = 0;
 }
 
+// The _k helpers take the geometry as arguments; kernels pass
+// either constants or the cfg fields (see Kernels below)
 
+static inline uint32_t
+gshare_index_k(bp_state *bp, uint32_t pc, int bits) {
+  return (pc ^ (uint32_t)bp->ghistory) & ((1u << bits) - 1);
+}
 
-uint8_t 
-gshare_predict(uint32_t pc) {
-  //get lower ghistoryBits of pc
-  uint32_t bht_entries = 1 << ghistoryBits;
-  uint32_t pc_lower_bits = pc & (bht_entries-1);
-  uint32_t ghistory_lower_bits = ghistory & (bht_entries -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
-  switch(bht_gshare[index]){
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-      return NOTTAKEN;
-  }
+static inline uint8_t
+gshare_predict_k(bp_state *bp, uint32_t pc, int bits) {
+  return ctr_taken(ctr2_get(bp->bht_gshare, gshare_index_k(bp, pc, bits)), 2);
 }
 
-void
-train_gshare(uint32_t pc, uint8_t outcome) {
-  //get lower ghistoryBits of pc
-  uint32_t bht_entries = 1 << ghistoryBits;
-  uint32_t pc_lower_bits = pc & (bht_entries-1);
-  uint32_t ghistory_lower_bits = ghistory & (bht_entries -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
+static inline void
+gshare_train_k(bp_state *bp, uint32_t pc, uint8_t outcome, int bits) {
+  uint32_t index = gshare_index_k(bp, pc, bits);
 
   //Update state of entry in bht based on outcome
-  switch(bht_gshare[index]){
-    case WN:
-      bht_gshare[index] = (outcome==TAKEN)?WT:SN;
-      break;
-    case SN:
-      bht_gshare[index] = (outcome==TAKEN)?WN:SN;
-      break;
-    case WT:
-      bht_gshare[index] = (outcome==TAKEN)?ST:WN;
-      break;
-    case ST:
-      bht_gshare[index] = (outcome==TAKEN)?ST:WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-  }
+  ctr2_set(bp->bht_gshare, index, ctr_update(ctr2_get(bp->bht_gshare, index), outcome, 2));
 
   //Update history register
-  ghistory = ((ghistory << 1) | outcome); 
+  bp->ghistory = ((bp->ghistory << 1) | outcome);
 }
 
-void
-cleanup_gshare() {
-  free(bht_gshare);
+// Predict and train one branch
+static inline uint8_t
+gshare_step_k(bp_state *bp, uint32_t pc, uint8_t outcome, int bits) {
+  uint8_t prediction = gshare_predict_k(bp, pc, bits);
+  gshare_train_k(bp, pc, outcome, bits);
+  return prediction;
 }
 
-// --------Tournament functions
+uint8_t
+gshare_predict(bp_state *bp, uint32_t pc) {
+  return gshare_predict_k(bp, pc, bp->cfg.ghistoryBits);
+}
 
-// init
+void
+train_gshare(bp_state *bp, uint32_t pc, uint8_t outcome) {
+  gshare_train_k(bp, pc, outcome, bp->cfg.ghistoryBits);
+}
 
-void init_tournament() {
-  tour_g_history = 0;
-  tour_g_bht = (uint8_t*)malloc(TOUR_G_ENTRY * sizeof(uint8_t));
+uint32_t
+gshare_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+                uint8_t *prediction, int n) {
+  int bits = bp->cfg.ghistoryBits;
+  uint32_t mask = (1u << bits) - 1;
+  uint32_t mispredictions = 0;
   int i = 0;
-  for(i = 0; i< TOUR_G_ENTRY; i++){
-    tour_g_bht[i] = WN;
-  }
-  // printf("tournament predictor's global pattern table has %d entries, and each entry is 2 bit\n", TOUR_G_ENTRY);
-
-  tour_l_history = (uint32_t*)malloc(TOUR_L_ENTRY * sizeof(uint32_t));
-  tour_l_pattern = (uint8_t*)malloc(my_pow2(TOUR_L_HISTORY) * sizeof(uint8_t));
-  for(i = 0; i< TOUR_L_ENTRY; i++){
-    tour_l_history[i] = 0;
+  if (bits >= BP_PREFETCH_MIN_BITS) {
+    // the history branch i + BP_PREFETCH_AHEAD will see
+    uint64_t ahead = bp->ghistory;
+    for (int j = 0; j < BP_PREFETCH_AHEAD && j < n; j++) {
+      ctr2_prefetch(bp->bht_gshare, (pc[j] ^ (uint32_t)ahead) & mask);
+      ahead = (ahead << 1) | outcome[j];
+    }
+    for (; i + BP_PREFETCH_AHEAD < n; i++) {
+      int j = i + BP_PREFETCH_AHEAD;
+      ctr2_prefetch(bp->bht_gshare, (pc[j] ^ (uint32_t)ahead) & mask);
+      ahead = (ahead << 1) | outcome[j];
+      mispredictions += simulate_miss(prediction, i, gshare_step_k(bp, pc[i], outcome[i], bits),
+                                    outcome[i]);
+    }
   }
-  for(i = 0; i< my_pow2(TOUR_L_HISTORY); i++){
-    tour_l_pattern[i] = WN;
+  for (; i < n; i++) {
+    mispredictions += simulate_miss(prediction, i, gshare_step_k(bp, pc[i], outcome[i], bits),
+                                    outcome[i]);
   }
-  // printf("tournament's l_pattern has %d entries\n", my_pow2(TOUR_L_HISTORY));
-  // for(i = 0; i< my_pow2(TOUR_L_HISTORY); i++){
-  //   printf("%u;", tour_l_pattern[i]);
-  // }
-  // printf("\n");
-  // printf("tournament predictor's local pattern table has %d entries, and each entry is 2 bit\n", my_pow2(TOUR_L_HISTORY));
-  // printf("tournament predictor's local table has %d entries, and each entry is %d bit\n", TOUR_L_ENTRY, TOUR_L_HISTORY);
+  return mispredictions;
+}
 
-  tour_c_choice = (uint8_t*)malloc(TOUR_C_ENTRY * sizeof(uint8_t));
-  for(i = 0; i< TOUR_C_ENTRY; i++){
-    tour_c_choice[i] = WN;
-  }
-  // printf("tournament predictor's choice pattern table has %d entries, and each entry is 2 bit\n", TOUR_C_ENTRY);
-  
+void
+cleanup_gshare(bp_state *bp) {
+  table_free(bp->bht_gshare);
 }
 
-// predict
+// --------Tournament functions
 
-uint8_t 
-tournament_g_predict(uint32_t pc) {
-  //get lower ghistoryBits of pc
-  uint32_t pc_lower_bits = pc & (TOUR_G_ENTRY-1);
-  uint32_t ghistory_lower_bits = tour_g_history & (TOUR_G_ENTRY -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
-  switch(tour_g_bht[index]){
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Tournament g predict!\n");
-      return NOTTAKEN;
-  }
+// init
+
+void init_tournament(bp_state *bp) {
+  bp->tour_g_history = 0;
+  bp->tour_g_bht = ctr2_alloc(TOUR_G_ENTRY(bp), WN);
+  bp->tour_l_history = field_alloc(TOUR_L_ENTRY(bp), TOUR_L_HISTORY(bp));
+  bp->tour_l_pattern = ctr2_alloc(my_pow2(TOUR_L_HISTORY(bp)), WN);
+  bp->tour_c_choice = ctr2_alloc(TOUR_C_ENTRY(bp), WN);
 }
 
-uint8_t 
-tournament_l_predict(uint32_t pc) {
-  // get lower bits of pc
-  uint32_t pc_lower_bits = pc & (TOUR_L_ENTRY-1);
-  // get local history of this branch
-  uint32_t local_history = tour_l_history[pc_lower_bits];
-  local_history = local_history & (my_pow2(TOUR_L_HISTORY) - 1);
-  // if (pc == 4259562) {
-  //     print_backward_binary(local_history);
-  // }
-  if (local_history >= my_pow2(TOUR_L_HISTORY)) {
-    printf("Error in l_predict: local_history is %u, but entry num is my_pow2(TOUR_L_HISTORY)\n", local_history);
-  }
-  
-  // get prediction
-  switch(tour_l_pattern[local_history]) {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Tournament l predict: %u\n", tour_l_pattern[local_history]);
-      return NOTTAKEN;
-  }
+// Everything one branch reads from the tournament tables, so a
+// prediction and the training that follows look it up once
+typedef struct tour_lookup {
+  uint32_t g_index;   // global pattern entry
+  uint32_t l_slot;    // local history entry
+  uint32_t l_history; // its history, the local pattern entry
+  uint32_t c_index;   // chooser entry
+  uint8_t g_predict;
+  uint8_t l_predict;
+  uint8_t choice;
+} tour_lookup;
+
+// gbits, lbits and ibits are tour_historyBits, lhistoryBits
+// and pcIndexBits
+static inline void
+tournament_lookup_k(bp_state *bp, uint32_t pc, tour_lookup *k, int gbits, int lbits, int ibits) {
+  uint32_t g_mask = (1u << gbits) - 1;
+  k->g_index = (pc ^ (uint32_t)bp->tour_g_history) & g_mask;
+  k->l_slot = pc & ((1u << ibits) - 1);
+  k->l_history = field_get(bp->tour_l_history, k->l_slot, lbits);
+  k->c_index = (uint32_t)bp->tour_g_history & g_mask;
+  k->g_predict = ctr_taken(ctr2_get(bp->tour_g_bht, k->g_index), 2);
+  k->l_predict = ctr_taken(ctr2_get(bp->tour_l_pattern, k->l_history), 2);
+  k->choice = ctr2_get(bp->tour_c_choice, k->c_index);
 }
 
-uint8_t 
-tournament_predict(uint32_t pc) {
-  uint8_t g_predict = tournament_g_predict(pc);
-  uint8_t l_predict = tournament_l_predict(pc);
-  //get lower bits of global_history
-  uint32_t g_lower_bits = tour_g_history & (TOUR_C_ENTRY-1);
-  switch(tour_c_choice[g_lower_bits]){
-    case WN:
-      return g_predict;
-    case SN:
-      return g_predict;
-    case WT:
-      return l_predict;
-    case ST:
-      return l_predict;
-    default:
-      printf("Warning: Undefined state of entry in Tournament predict choice!\n");
-      return g_predict;
-  }
+static inline uint8_t
+tournament_select(const tour_lookup *k) {
+  return ctr_taken(k->choice, 2) ? k->l_predict : k->g_predict;
+}
+
+static inline void
+tournament_train_k(bp_state *bp, const tour_lookup *k, uint8_t outcome, int lbits) {
+  // Note: different logic here. If l_predict is correct, rely more on local prediction.
+  // The chooser only moves when the two components disagree
+  uint8_t trained = ctr_update(k->choice, outcome == k->l_predict, 2);
+  ctr2_set(bp->tour_c_choice, k->c_index, (k->g_predict != k->l_predict) ? trained : k->choice);
+
+  // global part
+  ctr2_set(bp->tour_g_bht, k->g_index, ctr_update(ctr2_get(bp->tour_g_bht, k->g_index), outcome, 2));
+  bp->tour_g_history = ((bp->tour_g_history << 1) | outcome);
+
+  // local part
+  ctr2_set(bp->tour_l_pattern, k->l_history,
+           ctr_update(ctr2_get(bp->tour_l_pattern, k->l_history), outcome, 2));
+  field_set(bp->tour_l_history, k->l_slot, lbits, (k->l_history << 1) | outcome);
 }
 
-// train functions
+// Predict and train one branch
+static inline uint8_t
+tournament_step_k(bp_state *bp, uint32_t pc, uint8_t outcome, int gbits, int lbits, int ibits) {
+  tour_lookup k;
+  tournament_lookup_k(bp, pc, &k, gbits, lbits, ibits);
+  tournament_train_k(bp, &k, outcome, lbits);
+  return tournament_select(&k);
+}
+
+uint8_t
+tournament_predict(bp_state *bp, uint32_t pc) {
+  tour_lookup k;
+  tournament_lookup_k(bp, pc, &k, bp->cfg.tour_historyBits, bp->cfg.lhistoryBits, bp->cfg.pcIndexBits);
+  return tournament_select(&k);
+}
 
 void
-tournament_g_train(uint32_t pc, uint8_t outcome) {
-  //get lower bits of pc
-  uint32_t pc_lower_bits = pc & (TOUR_G_ENTRY-1);
-  uint32_t ghistory_lower_bits = tour_g_history & (TOUR_G_ENTRY -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
+tournament_train(bp_state *bp, uint32_t pc, uint8_t outcome) {
+  tour_lookup k;
+  tournament_lookup_k(bp, pc, &k, bp->cfg.tour_historyBits, bp->cfg.lhistoryBits, bp->cfg.pcIndexBits);
+  tournament_train_k(bp, &k, outcome, bp->cfg.lhistoryBits);
+}
 
-  //Update state of entry in bht based on outcome
-  switch(tour_g_bht[index]){
-    case WN:
-      tour_g_bht[index] = (outcome==TAKEN)?WT:SN;
-      break;
-    case SN:
-      tour_g_bht[index] = (outcome==TAKEN)?WN:SN;
-      break;
-    case WT:
-      tour_g_bht[index] = (outcome==TAKEN)?ST:WN;
-      break;
-    case ST:
-      tour_g_bht[index] = (outcome==TAKEN)?ST:WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in Tournament g train!\n");
+// Which tournament tables are worth prefetching
+#define TOUR_PREFETCH_GLOBAL   1 // global pattern and chooser
+#define TOUR_PREFETCH_LOCAL    2 // local histories
+#define TOUR_PREFETCH_PATTERN  4 // local patterns
+
+// Prefetch the 'which' entries of a branch at 'pc' that will
+// see global history 'history'. Forced inline: left to itself
+// GCC splits off the conditional part and then drops it, since
+// a prefetch neither reads nor writes memory as far as it knows
+static inline __attribute__((always_inline)) void
+tournament_prefetch_k(bp_state *bp, uint32_t pc, uint32_t history, int which,
+                      int gbits, int lbits, int ibits) {
+  uint32_t g_mask = (1u << gbits) - 1;
+  if (which & TOUR_PREFETCH_GLOBAL) {
+    ctr2_prefetch(bp->tour_g_bht, (pc ^ history) & g_mask);
+    ctr2_prefetch(bp->tour_c_choice, history & g_mask);
   }
-
-  //Update history register
-  tour_g_history = ((tour_g_history << 1) | outcome); 
-}
-
-void tournament_l_train(uint32_t pc, uint8_t outcome) {
-  // get lower bits of pc
-  uint32_t pc_lower_bits = pc & (TOUR_L_ENTRY-1);
-  // get local history of this branch
-  uint32_t local_history = tour_l_history[pc_lower_bits];
-  local_history &= (my_pow2(TOUR_L_HISTORY) - 1);
-  if (local_history >= my_pow2(TOUR_L_HISTORY)) {
-    printf("Error in l_train: local_history is %u, but entry num is my_pow2(TOUR_L_HISTORY)\n", local_history);
-  }
-  // train
-  switch(tour_l_pattern[local_history]) {
-    case WN:
-      tour_l_pattern[local_history] = (outcome==TAKEN)?WT:SN;
-      break;
-    case SN:
-      tour_l_pattern[local_history] = (outcome==TAKEN)?WN:SN;
-      break;
-    case WT:
-      tour_l_pattern[local_history] = (outcome==TAKEN)?ST:WN;
-      break;
-    case ST:
-      tour_l_pattern[local_history] = (outcome==TAKEN)?ST:WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in Tournament l train: %u!\n", tour_l_pattern[local_history]);
+  if (which & TOUR_PREFETCH_LOCAL) {
+    field_prefetch(bp->tour_l_history, pc & ((1u << ibits) - 1), lbits);
   }
-
-  // Update local history
-  tour_l_history[pc_lower_bits] <<= 1;
-  tour_l_history[pc_lower_bits] &= (my_pow2(TOUR_L_HISTORY) - 1);
-  tour_l_history[pc_lower_bits] |= outcome;
 }
 
-void
-tournament_train(uint32_t pc, uint8_t outcome) {
-  uint8_t g_predict = tournament_g_predict(pc);
-  uint8_t l_predict = tournament_l_predict(pc);
-  //get lower bits of global history
-  uint32_t g_lower_bits = tour_g_history & (TOUR_C_ENTRY-1);
-  if (g_predict != l_predict) {
-    switch(tour_c_choice[g_lower_bits]){
-      // Note: different logic here. If l_predict is correct, rely more on local prediction
-      case WN:
-        tour_c_choice[g_lower_bits] = (outcome != l_predict)?SN:WT;
-        break;
-      case SN:
-        tour_c_choice[g_lower_bits] = (outcome != l_predict)?SN:WN;
-        break;
-      case WT:
-        tour_c_choice[g_lower_bits] = (outcome != l_predict)?WN:ST;
-        break;
-      case ST:
-        tour_c_choice[g_lower_bits] = (outcome != l_predict)?WT:ST;
-        break;
-      default:
-        printf("Warning: Undefined state of entry in Tournament train choice!\n");
+uint32_t
+tournament_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+                    uint8_t *prediction, int n) {
+  int gbits = bp->cfg.tour_historyBits;
+  int lbits = bp->cfg.lhistoryBits;
+  int ibits = bp->cfg.pcIndexBits;
+  int which = (gbits >= BP_PREFETCH_MIN_BITS ? TOUR_PREFETCH_GLOBAL : 0) |
+              (ibits >= BP_PREFETCH_MIN_BITS - 3 ? TOUR_PREFETCH_LOCAL : 0) |
+              (lbits >= BP_PREFETCH_MIN_BITS ? TOUR_PREFETCH_PATTERN : 0);
+  uint32_t mispredictions = 0;
+  int i = 0;
+  if (which) {
+    uint64_t ahead = bp->tour_g_history;
+    for (int j = 0; j < BP_PREFETCH_AHEAD && j < n; j++) {
+      tournament_prefetch_k(bp, pc[j], (uint32_t)ahead, which, gbits, lbits, ibits);
+      ahead = (ahead << 1) | outcome[j];
     }
-  }
+    for (; i + BP_PREFETCH_AHEAD < n; i++) {
+      int j = i + BP_PREFETCH_AHEAD;
+      tournament_prefetch_k(bp, pc[j], (uint32_t)ahead, which, gbits, lbits, ibits);
+      ahead = (ahead << 1) | outcome[j];
+
+      // The local pattern entry hangs off a local history that
+      // is only final once the branch is reached; guess it from
+      // the current one for the branch half a window out
+      if (which & TOUR_PREFETCH_PATTERN) {
+        int h = i + BP_PREFETCH_AHEAD / 2;
+        ctr2_prefetch(bp->tour_l_pattern,
+                      field_get(bp->tour_l_history, pc[h] & ((1u << ibits) - 1), lbits));
+      }
 
-  tournament_g_train(pc, outcome);
-  tournament_l_train(pc, outcome);
+      mispredictions += simulate_miss(prediction, i,
+                                      tournament_step_k(bp, pc[i], outcome[i], gbits, lbits, ibits),
+                                      outcome[i]);
+    }
+  }
+  for (; i < n; i++) {
+    mispredictions += simulate_miss(prediction, i,
+                                    tournament_step_k(bp, pc[i], outcome[i], gbits, lbits, ibits),
+                                    outcome[i]);
+  }
+  return mispredictions;
 }
 
 // cleanup function
 
 void
-cleanup_tournament() {
-  free(tour_g_bht);
-  free(tour_l_history);
-  free(tour_l_pattern);
-  free(tour_c_choice);
+cleanup_tournament(bp_state *bp) {
+  table_free(bp->tour_g_bht);
+  table_free(bp->tour_l_history);
+  table_free(bp->tour_l_pattern);
+  table_free(bp->tour_c_choice);
 }
 
 //---------End of Tournament
@@ -443,326 +495,1250 @@ cleanup_tournament() {
 
 // utils
 
+void
+tage_fold_init(tage_fold *f, int len, int width) {
+  f->value = 0;
+  f->len = len;
+  f->width = width;
+}
+
+// Shift 'in' into the folded history and drop 'out', the bit that
+// just left the len-bit window
+static inline void
+tage_fold_update(tage_fold *f, uint32_t in, uint32_t out) {
+  f->value = (f->value << 1) | in;
+  f->value ^= out << (f->len % f->width);
+  f->value ^= f->value >> f->width;
+  f->value &= (1u << f->width) - 1;
+}
+
+// Global history bit 'age' branches ago (0 = newest)
+static inline uint32_t
+tage_history_bit(bp_state *bp, uint32_t age) {
+  uint32_t slot = (bp->tage_g_ptr + age) & (TAGE_G_HISTORY_LEN - 1);
+  return (bp->tage_g_history[slot >> 6] >> (slot & 63)) & 1;
+}
+
+void
+tage_push_history(bp_state *bp, uint8_t outcome) {
+  bp->tage_g_ptr = (bp->tage_g_ptr - 1) & (TAGE_G_HISTORY_LEN - 1);
+  uint32_t slot = bp->tage_g_ptr;
+  bp->tage_g_history[slot >> 6] &= ~(1ull << (slot & 63));
+  bp->tage_g_history[slot >> 6] |= (uint64_t)outcome << (slot & 63);
+
+  for (int i = 0; i < TAGE_COMP_NUM; i++) {
+    uint32_t out = tage_history_bit(bp, TAGE_HISTORY_LEN[i]);
+    tage_fold_update(&bp->tage_index_fold[i], outcome, out);
+    tage_fold_update(&bp->tage_tag_fold[i][0], outcome, out);
+    tage_fold_update(&bp->tage_tag_fold[i][1], outcome, out);
+  }
+}
+
 // init
 
-void init_tage() {
+void init_tage(bp_state *bp) {
 
   // base
-  tage_base_history = 0;
-  tage_base_gshare = (uint8_t*)malloc((my_pow2(ghistoryBits)) * sizeof(uint8_t));
+  bp->tage_base_history = 0;
+  bp->tage_base_gshare = ctr2_alloc(my_pow2(bp->cfg.ghistoryBits), WN);
   int i = 0;
-  for(i = 0; i< (my_pow2(ghistoryBits)); i++) {
-    tage_base_gshare[i] = WN;
-  }
 
   // component global
-  for(i = 0; i< TAGE_G_HISTORY_LEN; i++) {
-    tage_g_history[i] = 0;
+  for(i = 0; i< TAGE_G_HISTORY_LEN / 64; i++) {
+    bp->tage_g_history[i] = 0;
   }
-  tage_l_history = 0;
+  bp->tage_g_ptr = 0;
 
   // component each
   for(i = 0; i< TAGE_COMP_NUM; i++) {
-    tage_comp_entry_index[i] = 0;
+    bp->tage_comp_entry_index[i] = 0;
 
-    int j = 0;
-    for(j = 0; j< TAGE_COMP_ENTRY; j++) {
-      tage_comp_list[i].entry[j].choice = 00;
-      tage_comp_list[i].entry[j].tag = 0; // 10 0s 
-      tage_comp_list[i].entry[j].usage = 00;
-    }
+    memset(bp->tage_comp_list[i].entry, 0, sizeof(bp->tage_comp_list[i].entry));
 
-    tage_comp_list[i].len_history = TAGE_HISTORY_LEN[i];
+    bp->tage_comp_list[i].len_history = TAGE_HISTORY_LEN[i];
+    tage_fold_init(&bp->tage_index_fold[i], TAGE_HISTORY_LEN[i], TAGE_COMP_INDEX_BITS);
+    tage_fold_init(&bp->tage_tag_fold[i][0], TAGE_HISTORY_LEN[i], TAGE_TAG_LEN);
+    tage_fold_init(&bp->tage_tag_fold[i][1], TAGE_HISTORY_LEN[i], TAGE_TAG_LEN - 1);
   }
 
+  bp->tage_use_alt = 1 << (TAGE_USE_ALT_BITS - 1);
+  bp->tage_tick = 0;
+  bp->tage_seed = 0x2545f491;
 }
 
 // predict
 
-uint64_t hash1(uint32_t pc, uint8_t len_history) {
-  uint64_t result = 0;
-  for (int i = 0; i < len_history; i++) {
-    if ((pc & 1) ^ tage_g_history[i]) {
-      result += 1 << i;
-    }
-    pc = pc >> 1;
+// Index and tag of 'pc' in every component under the current history
+void
+tage_lookup(bp_state *bp, uint32_t pc) {
+  for (int i = 0; i < TAGE_COMP_NUM; i++) {
+    uint32_t index = pc ^ (pc >> (TAGE_COMP_INDEX_BITS - i)) ^ bp->tage_index_fold[i].value;
+    uint32_t tag = pc ^ bp->tage_tag_fold[i][0].value ^ (bp->tage_tag_fold[i][1].value << 1);
+    bp->tage_comp_entry_index[i] = index & (TAGE_COMP_ENTRY - 1);
+    bp->tage_comp_entry_tag[i] = tag & (my_pow2(TAGE_TAG_LEN) - 1);
   }
-  return result;
 }
 
-uint64_t hash2(uint32_t pc, uint8_t len_history) {
-  uint64_t result = 0;
-  for (int i = 0; i < len_history; i++) {
-    if ((pc & 1) ^ tage_g_history[i]) {
-      result += 1 << i;
+uint8_t
+tage_base_predict(bp_state *bp, uint32_t pc) {
+  uint32_t pc_lower_bits = pc & ((my_pow2(bp->cfg.ghistoryBits))-1);
+  uint32_t ghistory_lower_bits = bp->tage_base_history & ((my_pow2(bp->cfg.ghistoryBits)) -1);
+  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
+  return ctr_taken(ctr2_get(bp->tage_base_gshare, index), 2);
+}
+
+// Find the provider (longest matching component) and the
+// alternate (next longest), 200 when there is none
+void
+tage_match(bp_state *bp, uint8_t *index_provider, uint8_t *index_candidate) {
+  *index_provider = 200;
+  *index_candidate = 200;
+  for (int i = 0; i < TAGE_COMP_NUM; i++) {
+    comp_entry *entry = &bp->tage_comp_list[i].entry[bp->tage_comp_entry_index[i]];
+    if (entry->tag == bp->tage_comp_entry_tag[i]) {
+      if (*index_provider == 200) {
+        *index_provider = i;
+      } else {
+        *index_candidate = i;
+        return;
+      }
     }
-    pc = pc << 1;
   }
-  return result;
 }
 
-int early_break = 0;
-int all_count = 0;
+// True for an entry that looks freshly allocated: weak and not
+// (yet) useful
+static inline uint8_t
+tage_fresh(comp_entry *entry) {
+  uint8_t weak_taken = 1 << (TAGE_CTR_BITS - 1);
+  return entry->usage == 0 &&
+         (entry->choice == weak_taken || entry->choice == weak_taken - 1);
+}
 
-uint8_t 
-tage_predict(uint32_t pc) {
-  uint8_t final_predict = NOTTAKEN;
-  uint8_t base_predict = NOTTAKEN;
-
-  uint8_t index_provider = 200;
-  uint8_t index_candidate = 200;
-  uint64_t hash_provider = 0;
-  uint64_t hash_candidate = 0;
-  uint8_t flag_all_one = 1;
-  uint32_t pc_copy = pc;
-
-  // for (int i = 0; i < TAGE_COMP_NUM; i++) {
-  //   if ((pc_copy & 1) == 0) {
-  //     flag_all_one = 0;
-  //     break;
-  //   }
-  //   pc_copy = pc_copy >> 1;
-  // }
-  // all_count++;
-  // if (flag_all_one == 1) {
-  //   early_break++;
-  //   // printf("early vs all: %d vs %d\n", early_break, all_count);
-  //   return base_predict;
-  // }
-
-  uint32_t pc_lower_bits = pc & ((my_pow2(ghistoryBits))-1);
-  uint32_t ghistory_lower_bits = tage_base_history & ((my_pow2(ghistoryBits)) -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
-  switch(tage_base_gshare[index]){
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      // printf("Warning: Undefined state of entry in TAGE base GSHARE BHT!\n");
-      return NOTTAKEN;
+// A fresh provider is often worse than the alternate;
+// tage_use_alt learns whether it is
+static uint8_t
+tage_choose(bp_state *bp, comp_entry *provider, uint8_t alt_predict) {
+  if (tage_fresh(provider) && ctr_taken(bp->tage_use_alt, TAGE_USE_ALT_BITS)) {
+    return alt_predict;
   }
+  return ctr_taken(provider->choice, TAGE_CTR_BITS);
+}
 
+uint8_t 
+tage_predict(bp_state *bp, uint32_t pc) {
+  uint8_t index_provider;
+  uint8_t index_candidate;
+  uint8_t base_predict = tage_base_predict(bp, pc);
 
-  for (int i = 0; i < TAGE_COMP_NUM; i++) {
-    uint64_t hash_1 = hash1(pc, tage_comp_list[i].len_history);
-    hash_1 = hash_1 & (TAGE_COMP_ENTRY - 1);
-    uint64_t hash_2 = hash2(pc, tage_comp_list[i].len_history);
-    hash_2 = hash_2 & (my_pow2(TAGE_TAG_LEN) - 1);
-    comp_entry entry = tage_comp_list[i].entry[hash_1];
-    if (entry.tag == hash_2) {
-      if (index_provider == 200) {
-        index_provider = i;
-        hash_provider = hash_1;
-      } else {
-        index_candidate = i;
-        hash_candidate = hash_1;
-      }
-    }
-  }
+  tage_lookup(bp, pc);
+  tage_match(bp, &index_provider, &index_candidate);
 
   if (index_provider == 200) {
-    final_predict = base_predict;
-  } else {
-    switch (tage_comp_list[index_provider].entry[hash_provider].choice) {
-      case WN:
-        final_predict =  NOTTAKEN;
-      case SN:
-        final_predict =  NOTTAKEN;
-      case WT:
-        final_predict =  TAKEN;
-      case ST:
-        final_predict =  TAKEN;
-      default:
-        printf("Warning: Undefined state of entry in TAGE base GSHARE BHT!\n");
-        final_predict =  NOTTAKEN;
-    }
+    return base_predict;
+  }
+
+  uint8_t alt_predict = base_predict;
+  if (index_candidate != 200) {
+    comp_entry *candidate = &bp->tage_comp_list[index_candidate].entry[bp->tage_comp_entry_index[index_candidate]];
+    alt_predict = ctr_taken(candidate->choice, TAGE_CTR_BITS);
   }
-  
-  return final_predict;
+  comp_entry *provider = &bp->tage_comp_list[index_provider].entry[bp->tage_comp_entry_index[index_provider]];
+  return tage_choose(bp, provider, alt_predict);
 }
 
 
 
 // train
 
+// On a misprediction, claim a not-useful entry in a component with
+// a longer history than the provider; age them all if none is free
 void
-tage_train(uint32_t pc, uint8_t outcome) {
-  //get lower ghistoryBits of pc
-  uint32_t pc_lower_bits = pc & ((my_pow2(ghistoryBits))-1);
-  uint32_t ghistory_lower_bits = tage_base_history & ((my_pow2(ghistoryBits)) -1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
-  //Update history register
-  tage_base_history = ((tage_base_history << 1) | outcome); 
+tage_allocate(bp_state *bp, uint8_t index_provider, uint8_t outcome) {
+  int longer = (index_provider == 200) ? TAGE_COMP_NUM : index_provider;
+  if (longer == 0) {
+    return;
+  }
 
-  //Update state of entry in bht based on outcome
-  switch(tage_base_gshare[index]){
-    case WN:
-      tage_base_gshare[index] = (outcome==TAKEN)?WT:SN;
-      return;
-    case SN:
-      tage_base_gshare[index] = (outcome==TAKEN)?WN:SN;
-      return;
-    case WT:
-      tage_base_gshare[index] = (outcome==TAKEN)?ST:WN;
-      return;
-    case ST:
-      tage_base_gshare[index] = (outcome==TAKEN)?ST:WT;
-      return;
-    default:
-      // printf("Warning: Undefined state of entry in TAGE base GSHARE BHT!\n");
+  // start at a random longer component so allocations spread out
+  bp->tage_seed = bp->tage_seed * 1103515245 + 12345;
+  int start = (bp->tage_seed >> 16) % longer;
+  for (int k = 0; k < longer; k++) {
+    int i = (start + longer - k) % longer;
+    comp_entry *entry = &bp->tage_comp_list[i].entry[bp->tage_comp_entry_index[i]];
+    if (entry->usage == 0) {
+      entry->tag = bp->tage_comp_entry_tag[i];
+      entry->choice = (1 << (TAGE_CTR_BITS - 1)) - (outcome == NOTTAKEN);
       return;
+    }
   }
 
-  uint8_t final_predict = NOTTAKEN;
-  uint8_t index_provider = 200;
-  uint8_t index_candidate = 200;
-  uint64_t hash_provider = 0;
-  uint64_t hash_candidate = 0;
-  for (int i = 0; i < TAGE_COMP_NUM; i++) {
-    uint64_t hash_1 = hash1(pc, tage_comp_list[i].len_history);
-    hash_1 = hash_1 & (TAGE_COMP_ENTRY - 1);
-    uint64_t hash_2 = hash2(pc, tage_comp_list[i].len_history);
-    hash_2 = hash_2 & (my_pow2(TAGE_TAG_LEN) - 1);
-    comp_entry entry = tage_comp_list[i].entry[hash_1];
-    if (entry.tag == hash_2) {
-      if (index_provider == 200) {
-        index_provider = i;
-        hash_provider = hash_1;
-      } else {
-        index_candidate = i;
-        hash_candidate = hash_1;
-      }
-    }
+  for (int i = 0; i < longer; i++) {
+    comp_entry *entry = &bp->tage_comp_list[i].entry[bp->tage_comp_entry_index[i]];
+    entry->usage = ctr_update(entry->usage, NOTTAKEN, TAGE_U_BITS);
   }
+}
 
+void
+tage_train(bp_state *bp, uint32_t pc, uint8_t outcome) {
+  uint8_t index_provider;
+  uint8_t index_candidate;
+  uint8_t base_predict = tage_base_predict(bp, pc);
+
+  tage_lookup(bp, pc);
+  tage_match(bp, &index_provider, &index_candidate);
+
+  uint8_t final_predict = base_predict;
   if (index_provider == 200) {
-    return;
+    //get lower ghistoryBits of pc
+    uint32_t pc_lower_bits = pc & ((my_pow2(bp->cfg.ghistoryBits))-1);
+    uint32_t ghistory_lower_bits = bp->tage_base_history & ((my_pow2(bp->cfg.ghistoryBits)) -1);
+    uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
+
+    //Update state of entry in bht based on outcome
+    ctr2_set(bp->tage_base_gshare, index, ctr_update(ctr2_get(bp->tage_base_gshare, index), outcome, 2));
   } else {
-    switch (tage_comp_list[index_provider].entry[hash_provider].choice) {
-      case WN:
-        final_predict = NOTTAKEN;
-        tage_comp_list[index_provider].entry[hash_provider].choice = (outcome==TAKEN)?WT:SN;
-      case SN:
-        final_predict = NOTTAKEN;
-        tage_comp_list[index_provider].entry[hash_provider].choice = (outcome==TAKEN)?WN:SN;
-      case WT:
-        final_predict = TAKEN;
-        tage_comp_list[index_provider].entry[hash_provider].choice = (outcome==TAKEN)?ST:WN;
-      case ST:
-        final_predict = TAKEN;
-        tage_comp_list[index_provider].entry[hash_provider].choice = (outcome==TAKEN)?ST:WT;
-      default:
-        printf("Warning: Undefined state of entry in TAGE base GSHARE BHT!\n");
+    comp_entry *provider = &bp->tage_comp_list[index_provider].entry[bp->tage_comp_entry_index[index_provider]];
+    uint8_t provider_predict = ctr_taken(provider->choice, TAGE_CTR_BITS);
+    uint8_t alt_predict = base_predict;
+    if (index_candidate != 200) {
+      comp_entry *candidate = &bp->tage_comp_list[index_candidate].entry[bp->tage_comp_entry_index[index_candidate]];
+      alt_predict = ctr_taken(candidate->choice, TAGE_CTR_BITS);
     }
+    final_predict = tage_choose(bp, provider, alt_predict);
 
-    if (index_candidate == 200) {
-      return;
-    } else {
-      switch (tage_comp_list[index_candidate].entry[hash_candidate].choice) {
-        case WN:
-          tage_comp_list[index_candidate].entry[hash_candidate].choice = (outcome==TAKEN)?WT:SN;
-        case SN:
-          tage_comp_list[index_candidate].entry[hash_candidate].choice = (outcome==TAKEN)?WN:SN;
-        case WT:
-          tage_comp_list[index_candidate].entry[hash_candidate].choice = (outcome==TAKEN)?ST:WN;
-        case ST:
-          tage_comp_list[index_candidate].entry[hash_candidate].choice = (outcome==TAKEN)?ST:WT;
-        default:
-          printf("Warning: Undefined state of entry in TAGE base GSHARE BHT!\n");
-      }
-
-      if (final_predict != tage_comp_list[index_candidate].entry[hash_candidate].choice) {
-        tage_comp_list[index_candidate].entry[hash_candidate].usage --;
-        if (tage_comp_list[index_candidate].entry[hash_candidate].usage < 0) {
-          tage_comp_list[index_candidate].entry[hash_candidate].usage = 0;
-        }
-      } else {
-        tage_comp_list[index_candidate].entry[hash_candidate].usage ++;
-        if (tage_comp_list[index_candidate].entry[hash_candidate].usage > 3) {
-          tage_comp_list[index_candidate].entry[hash_candidate].usage = 3;
-        }
-      }
+    // learn whether fresh providers should defer to the alternate
+    if (tage_fresh(provider) && provider_predict != alt_predict) {
+      bp->tage_use_alt = ctr_update(bp->tage_use_alt, alt_predict == outcome, TAGE_USE_ALT_BITS);
+    }
 
-      
+    // usage is a 2-bit counter of the provider being right where the alternate is not
+    if (provider_predict != alt_predict) {
+      provider->usage = ctr_update(provider->usage, provider_predict == outcome, TAGE_U_BITS);
     }
+    provider->choice = ctr_update(provider->choice, outcome, TAGE_CTR_BITS);
+  }
 
+  if (final_predict != outcome) {
+    tage_allocate(bp, index_provider, outcome);
   }
+
+  // periodically decay usefulness so stale entries can be replaced
+  if (++bp->tage_tick == TAGE_U_RESET_PERIOD) {
+    bp->tage_tick = 0;
+    for (int i = 0; i < TAGE_COMP_NUM; i++) {
+      for (int j = 0; j < TAGE_COMP_ENTRY; j++) {
+        bp->tage_comp_list[i].entry[j].usage >>= 1;
+      }
+    }
+  }
+
+  //Update history registers
+  bp->tage_base_history = ((bp->tage_base_history << 1) | outcome); 
+  tage_push_history(bp, outcome);
 }
 
 
+void
+cleanup_tage(bp_state *bp) {
+  table_free(bp->tage_base_gshare);
+}
+
 //---------End of TAGE
 
+//---------Perceptron functions
+
 void
-init_predictor()
+init_perceptron(bp_state *bp) {
+  uint32_t h = bp->cfg.perc_historyLen;
+  size_t rows = bp->cfg.perc_entries;
+
+  bp->perc_stride = perc_stride(h);
+  bp->perc_weights = (int8_t*)table_alloc(rows * bp->perc_stride, 0);
+  bp->perc_bias = (int8_t*)table_alloc(rows, 0);
+  bp->perc_mask = (int8_t*)table_alloc(bp->perc_stride, 0);
+  for (uint32_t i = 0; i < bp->perc_stride; i++) {
+    bp->perc_mask[i] = i < h ? -1 : 0;
+  }
+
+  // The history is kept twice over, h lanes apart, so the newest
+  // perc_stride lanes are always contiguous from perc_pos; lanes
+  // past h in that window meet pad weights
+  bp->perc_history = (int8_t*)malloc(h + bp->perc_stride);
+  memset(bp->perc_history, -1, h + bp->perc_stride);
+  bp->perc_pos = 0;
+  bp->perc_theta = PERC_THETA(h);
+}
+
+static inline uint32_t
+perceptron_row(bp_state *bp, uint32_t pc) {
+  return (uint32_t)(((uint64_t)(pc * 0x9E3779B1u) * bp->cfg.perc_entries) >> 32);
+}
+
+static inline void
+perceptron_push(bp_state *bp, uint8_t outcome) {
+  uint32_t h = bp->cfg.perc_historyLen;
+  bp->perc_pos = bp->perc_pos ? bp->perc_pos - 1 : h - 1;
+  bp->perc_history[bp->perc_pos] = outcome ? 1 : -1;
+  bp->perc_history[bp->perc_pos + h] = outcome ? 1 : -1;
+}
+
+// Dot product of 'n' weights with the history lanes 'x'
+static inline int32_t
+perc_dot_scalar(const int8_t *w, const int8_t *x, uint32_t n) {
+  int32_t y = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    y += w[i] * x[i];
+  }
+  return y;
+}
+
+// Move the weights one step towards agreeing with 'outcome'
+// on every lane of 'mask'
+static inline void
+perc_update_scalar(int8_t *w, const int8_t *x, const int8_t *mask, uint32_t n, uint8_t outcome) {
+  for (uint32_t i = 0; i < n; i++) {
+    int v = w[i] + ((outcome ? x[i] : -x[i]) & mask[i]);
+    w[i] = v > PERC_WEIGHT_MAX ? PERC_WEIGHT_MAX : (v < -PERC_WEIGHT_MAX ? -PERC_WEIGHT_MAX : v);
+  }
+}
+
+#ifdef __SSE2__
+static inline int32_t
+perc_dot_sse2(const int8_t *w, const int8_t *x, uint32_t n) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i ones = _mm_set1_epi16(1);
+  __m128i sum = zero;
+  for (uint32_t i = 0; i < n; i += 16) {
+    // negate the weights facing not-taken lanes, then widen
+    __m128i neg = _mm_cmplt_epi8(_mm_loadu_si128((const __m128i*)(x + i)), zero);
+    __m128i v = _mm_load_si128((const __m128i*)(w + i));
+    v = _mm_sub_epi8(_mm_xor_si128(v, neg), neg);
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+    __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_add_epi16(lo, hi), ones));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+static inline void
+perc_update_sse2(int8_t *w, const int8_t *x, const int8_t *mask, uint32_t n, uint8_t outcome) {
+  __m128i flip = _mm_set1_epi8(outcome ? 0 : -1);
+  __m128i min = _mm_set1_epi8(-PERC_WEIGHT_MAX - 1);
+  for (uint32_t i = 0; i < n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i*)(x + i));
+    d = _mm_sub_epi8(_mm_xor_si128(d, flip), flip);
+    d = _mm_and_si128(d, _mm_load_si128((const __m128i*)(mask + i)));
+    __m128i v = _mm_adds_epi8(_mm_load_si128((const __m128i*)(w + i)), d);
+    // saturation may reach -128; step it back to -127
+    v = _mm_sub_epi8(v, _mm_cmpeq_epi8(v, min));
+    _mm_store_si128((__m128i*)(w + i), v);
+  }
+}
+#endif
+
+#ifdef PERC_X86
+__attribute__((target("avx2"))) static inline int32_t
+perc_dot_avx2(const int8_t *w, const int8_t *x, uint32_t n) {
+  __m256i ones8 = _mm256_set1_epi8(1);
+  __m256i ones16 = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for (uint32_t i = 0; i < n; i += 32) {
+    __m256i v = _mm256_sign_epi8(_mm256_load_si256((const __m256i*)(w + i)),
+                                 _mm256_loadu_si256((const __m256i*)(x + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, v), ones16));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+  return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2"))) static inline void
+perc_update_avx2(int8_t *w, const int8_t *x, const int8_t *mask, uint32_t n, uint8_t outcome) {
+  __m256i sign = _mm256_set1_epi8(outcome ? 1 : -1);
+  __m256i min = _mm256_set1_epi8(-PERC_WEIGHT_MAX);
+  for (uint32_t i = 0; i < n; i += 32) {
+    __m256i d = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(x + i)), sign);
+    d = _mm256_and_si256(d, _mm256_load_si256((const __m256i*)(mask + i)));
+    __m256i v = _mm256_adds_epi8(_mm256_load_si256((const __m256i*)(w + i)), d);
+    _mm256_store_si256((__m256i*)(w + i), _mm256_max_epi8(v, min));
+  }
+}
+#endif
+
+// The best the build targets; on x86 without AVX2 in the build,
+// select_kernel still picks the AVX2 kernel on CPUs that have it
+#if defined(__AVX2__)
+#define perc_dot_vec perc_dot_avx2
+#define perc_update_vec perc_update_avx2
+#elif defined(__SSE2__)
+#define perc_dot_vec perc_dot_sse2
+#define perc_update_vec perc_update_sse2
+#else
+#define perc_dot_vec perc_dot_scalar
+#define perc_update_vec perc_update_scalar
+#endif
+
+// Output of row 'r' under the current history
+#define PERCEPTRON_OUTPUT(bp, r, DOT)                                         \
+  ((bp)->perc_bias[r] +                                                       \
+   DOT((bp)->perc_weights + (size_t)(r) * (bp)->perc_stride,                  \
+       (bp)->perc_history + (bp)->perc_pos, (bp)->perc_stride))
+
+// Train row 'r', whose output was 'y', when it mispredicted or
+// was not confident; then shift 'outcome' into the history
+#define PERCEPTRON_LEARN(bp, r, y, outcome, UPDATE)                           \
+  do {                                                                        \
+    if (((y) >= 0) != (outcome) || ((y) <= (bp)->perc_theta &&                \
+                                    (y) >= -(bp)->perc_theta)) {              \
+      UPDATE((bp)->perc_weights + (size_t)(r) * (bp)->perc_stride,            \
+             (bp)->perc_history + (bp)->perc_pos, (bp)->perc_mask,            \
+             (bp)->perc_stride, (outcome));                                   \
+      int b = (bp)->perc_bias[r] + ((outcome) ? 1 : -1);                      \
+      if (b >= -PERC_WEIGHT_MAX && b <= PERC_WEIGHT_MAX) {                    \
+        (bp)->perc_bias[r] = b;                                               \
+      }                                                                       \
+    }                                                                         \
+    perceptron_push((bp), (outcome));                                         \
+  } while (0)
+
+void
+cleanup_perceptron(bp_state *bp) {
+  table_free(bp->perc_weights);
+  table_free(bp->perc_bias);
+  free(bp->perc_history);
+  table_free(bp->perc_mask);
+}
+
+//---------End of Perceptron
+
+
+//------------------------------------//
+//              Kernels               //
+//------------------------------------//
+//
+// A kernel is the predict/train pair of one scheme plus a loop
+// over both for bp_simulate. Those stamped out below for the
+// geometries we run most have table sizes and history widths
+// as compile-time constants, so the masks fold away and the
+// packed-table helpers inline into one loop; any other
+// geometry gets the generic kernel, which reads them from cfg
+//
+
+uint8_t
+static_predict(bp_state *bp, uint32_t pc) {
+  return TAKEN;
+}
+
+uint32_t
+static_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+                uint8_t *prediction, int n) {
+  int bits = bp->cfg.ghistoryBits;
+  uint32_t mispredictions = 0;
+  for (int i = 0; i < n; i++) {
+    mispredictions += simulate_miss(prediction, i, TAKEN, outcome[i]);
+    gshare_train_k(bp, pc[i], outcome[i], bits);
+  }
+  return mispredictions;
+}
+
+uint32_t
+tage_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+              uint8_t *prediction, int n) {
+  uint32_t mispredictions = 0;
+  for (int i = 0; i < n; i++) {
+    mispredictions += simulate_miss(prediction, i, tage_predict(bp, pc[i]), outcome[i]);
+    tage_train(bp, pc[i], outcome[i]);
+  }
+  return mispredictions;
+}
+
+// No scheme: predict not taken, learn nothing
+uint8_t
+none_predict(bp_state *bp, uint32_t pc) {
+  return NOTTAKEN;
+}
+
+void
+none_train(bp_state *bp, uint32_t pc, uint8_t outcome) {
+}
+
+uint32_t
+none_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+              uint8_t *prediction, int n) {
+  uint32_t mispredictions = 0;
+  for (int i = 0; i < n; i++) {
+    mispredictions += simulate_miss(prediction, i, NOTTAKEN, outcome[i]);
+  }
+  return mispredictions;
+}
+
+#define GSHARE_KERNEL(G)                                                      \
+  static uint8_t                                                              \
+  gshare_predict_##G(bp_state *bp, uint32_t pc) {                             \
+    return gshare_predict_k(bp, pc, G);                                       \
+  }                                                                           \
+  static void                                                                 \
+  gshare_train_##G(bp_state *bp, uint32_t pc, uint8_t outcome) {              \
+    gshare_train_k(bp, pc, outcome, G);                                       \
+  }                                                                           \
+  static uint32_t                                                             \
+  gshare_simulate_##G(bp_state *bp, const uint32_t *pc,                       \
+                      const uint8_t *outcome, uint8_t *prediction, int n) {   \
+    uint32_t mispredictions = 0;                                              \
+    for (int i = 0; i < n; i++) {                                             \
+      mispredictions += simulate_miss(prediction, i,                          \
+                                      gshare_step_k(bp, pc[i], outcome[i], G),\
+                                      outcome[i]);                            \
+    }                                                                         \
+    return mispredictions;                                                    \
+  }
+
+#define TOURNAMENT_KERNEL(G, L, I)                                            \
+  static uint8_t                                                              \
+  tournament_predict_##G##_##L##_##I(bp_state *bp, uint32_t pc) {             \
+    tour_lookup k;                                                            \
+    tournament_lookup_k(bp, pc, &k, G, L, I);                                 \
+    return tournament_select(&k);                                             \
+  }                                                                           \
+  static void                                                                 \
+  tournament_train_##G##_##L##_##I(bp_state *bp, uint32_t pc,                 \
+                                   uint8_t outcome) {                         \
+    tour_lookup k;                                                            \
+    tournament_lookup_k(bp, pc, &k, G, L, I);                                 \
+    tournament_train_k(bp, &k, outcome, L);                                   \
+  }                                                                           \
+  static uint32_t                                                             \
+  tournament_simulate_##G##_##L##_##I(bp_state *bp, const uint32_t *pc,       \
+                                      const uint8_t *outcome,                 \
+                                      uint8_t *prediction, int n) {           \
+    uint32_t mispredictions = 0;                                              \
+    for (int i = 0; i < n; i++) {                                             \
+      mispredictions += simulate_miss(prediction, i,                          \
+        tournament_step_k(bp, pc[i], outcome[i], G, L, I), outcome[i]);       \
+    }                                                                         \
+    return mispredictions;                                                    \
+  }
+
+#define GSHARE_ENTRY(G) \
+  { GSHARE, { G, 0, 0 }, gshare_predict_##G, gshare_train_##G, gshare_simulate_##G }
+#define TOURNAMENT_ENTRY(G, L, I) \
+  { TOURNAMENT, { G, L, I }, tournament_predict_##G##_##L##_##I, \
+    tournament_train_##G##_##L##_##I, tournament_simulate_##G##_##L##_##I }
+
+// The defaults, their neighbours and the Alpha 21264 tournament
+GSHARE_KERNEL(12)
+GSHARE_KERNEL(13)
+GSHARE_KERNEL(14)
+GSHARE_KERNEL(15)
+GSHARE_KERNEL(16)
+TOURNAMENT_KERNEL(12, 11, 10)
+TOURNAMENT_KERNEL(9, 10, 10)
+
+#define PERCEPTRON_KERNEL(NAME, TARGET, DOT, UPDATE)                          \
+  TARGET static uint8_t                                                       \
+  perceptron_predict_##NAME(bp_state *bp, uint32_t pc) {                      \
+    uint32_t r = perceptron_row(bp, pc);                                      \
+    return PERCEPTRON_OUTPUT(bp, r, DOT) >= 0;                                \
+  }                                                                           \
+  TARGET static void                                                          \
+  perceptron_train_##NAME(bp_state *bp, uint32_t pc, uint8_t outcome) {       \
+    uint32_t r = perceptron_row(bp, pc);                                      \
+    int32_t y = PERCEPTRON_OUTPUT(bp, r, DOT);                                \
+    PERCEPTRON_LEARN(bp, r, y, outcome, UPDATE);                              \
+  }                                                                           \
+  TARGET static uint32_t                                                      \
+  perceptron_simulate_##NAME(bp_state *bp, const uint32_t *pc,                \
+                             const uint8_t *outcome, uint8_t *prediction,     \
+                             int n) {                                         \
+    uint32_t mispredictions = 0;                                              \
+    for (int i = 0; i < n; i++) {                                             \
+      uint32_t r = perceptron_row(bp, pc[i]);                                 \
+      int32_t y = PERCEPTRON_OUTPUT(bp, r, DOT);                              \
+      mispredictions += simulate_miss(prediction, i, y >= 0, outcome[i]);     \
+      PERCEPTRON_LEARN(bp, r, y, outcome[i], UPDATE);                         \
+    }                                                                         \
+    return mispredictions;                                                    \
+  }
+
+PERCEPTRON_KERNEL(vec, , perc_dot_vec, perc_update_vec)
+#if defined(PERC_X86) && !defined(__AVX2__)
+PERCEPTRON_KERNEL(avx2, __attribute__((target("avx2"))), perc_dot_avx2, perc_update_avx2)
+
+static const bp_kernel perceptron_avx2_kernel =
+  { PERCEPTRON, { 0, 0, 0 }, perceptron_predict_avx2, perceptron_train_avx2,
+    perceptron_simulate_avx2 };
+#endif
+
+static const bp_kernel specialised_kernels[] = {
+  GSHARE_ENTRY(12),
+  GSHARE_ENTRY(13),
+  GSHARE_ENTRY(14),
+  GSHARE_ENTRY(15),
+  GSHARE_ENTRY(16),
+  TOURNAMENT_ENTRY(12, 11, 10),
+  TOURNAMENT_ENTRY(9, 10, 10),
+};
+
+static const bp_kernel generic_kernels[] = {
+  { STATIC,     { 0, 0, 0 }, static_predict,     train_gshare,     static_simulate },
+  { GSHARE,     { 0, 0, 0 }, gshare_predict,     train_gshare,     gshare_simulate },
+  { TOURNAMENT, { 0, 0, 0 }, tournament_predict, tournament_train, tournament_simulate },
+  { CUSTOM,     { 0, 0, 0 }, tage_predict,       tage_train,       tage_simulate },
+  { PERCEPTRON, { 0, 0, 0 }, perceptron_predict_vec, perceptron_train_vec,
+    perceptron_simulate_vec },
+};
+
+static const bp_kernel none_kernel =
+  { -1, { 0, 0, 0 }, none_predict, none_train, none_simulate };
+
+// The kernel specialised for 'cfg' if there is one, else the
+// generic kernel of its scheme
+static const bp_kernel *
+select_kernel(const bp_config *cfg) {
+  int bits[3] = { 0, 0, 0 };
+  if (cfg->bpType == GSHARE) {
+    bits[0] = cfg->ghistoryBits;
+  } else if (cfg->bpType == TOURNAMENT) {
+    bits[0] = cfg->tour_historyBits;
+    bits[1] = cfg->lhistoryBits;
+    bits[2] = cfg->pcIndexBits;
+  }
+
+#if defined(PERC_X86) && !defined(__AVX2__)
+  if (cfg->bpType == PERCEPTRON && __builtin_cpu_supports("avx2")) {
+    return &perceptron_avx2_kernel;
+  }
+#endif
+
+  int count = sizeof(specialised_kernels) / sizeof(specialised_kernels[0]);
+  for (int i = 0; i < count; i++) {
+    const bp_kernel *k = &specialised_kernels[i];
+    if (k->bpType == cfg->bpType && !memcmp(k->bits, bits, sizeof(bits))) {
+      return k;
+    }
+  }
+  count = sizeof(generic_kernels) / sizeof(generic_kernels[0]);
+  for (int i = 0; i < count; i++) {
+    if (generic_kernels[i].bpType == cfg->bpType) {
+      return &generic_kernels[i];
+    }
+  }
+  return &none_kernel;
+}
+
+//------------------------------------//
+//        Predictor Instances         //
+//------------------------------------//
+
+void
+bp_default_config(bp_config *cfg, int type)
+{
+  cfg->bpType = type;
+  cfg->ghistoryBits = ghistoryBits;
+  cfg->tour_historyBits = tour_historyBits;
+  cfg->lhistoryBits = lhistoryBits;
+  cfg->pcIndexBits = pcIndexBits;
+  cfg->perc_historyLen = perceptronHistory;
+  cfg->perc_entries = perceptronEntries;
+}
+
+bp_state *
+bp_create(const bp_config *cfg)
 {
-  switch (bpType) {
+  bp_state *bp = (bp_state*)calloc(1, sizeof(bp_state));
+  bp->cfg = *cfg;
+
+  switch (bp->cfg.bpType) {
     case STATIC:
     case GSHARE:
-      init_gshare();
+      init_gshare(bp);
       break;
     case TOURNAMENT:
-      init_tournament();
+      init_tournament(bp);
       break;
     case CUSTOM:
-      init_tage();
+      init_tage(bp);
+      break;
+    case PERCEPTRON:
+      init_perceptron(bp);
       break;
     default:
       break;
   }
-  
+  bp->kernel = select_kernel(&bp->cfg);
+
+  return bp;
 }
 
-// Make a prediction for conditional branch instruction at PC 'pc'
-// Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
-// indicates a prediction of not taken
+void
+bp_report_tables(bp_state *bp, FILE *out)
+{
+  char spec[64];
+  bp_format_config(&bp->cfg, spec, sizeof(spec));
+  fprintf(out, "Tables of %s:\n", spec);
+
+  size_t total = 0;
+  switch (bp->cfg.bpType) {
+    case STATIC:
+    case GSHARE:
+      table_report("gshare", bp->bht_gshare, out);
+      total = table_bytes(bp->bht_gshare);
+      break;
+    case TOURNAMENT:
+      table_report("global", bp->tour_g_bht, out);
+      table_report("choice", bp->tour_c_choice, out);
+      table_report("local history", bp->tour_l_history, out);
+      table_report("local pattern", bp->tour_l_pattern, out);
+      total = table_bytes(bp->tour_g_bht) + table_bytes(bp->tour_c_choice) +
+              table_bytes(bp->tour_l_history) + table_bytes(bp->tour_l_pattern);
+      break;
+    case CUSTOM:
+      // the tagged components live inside bp_state
+      table_report("base gshare", bp->tage_base_gshare, out);
+      total = table_bytes(bp->tage_base_gshare);
+      break;
+    case PERCEPTRON:
+      table_report("weights", bp->perc_weights, out);
+      table_report("bias", bp->perc_bias, out);
+      total = table_bytes(bp->perc_weights) + table_bytes(bp->perc_bias);
+      break;
+    default:
+      break;
+  }
+  fprintf(out, "  %-20s %14zu bytes\n", "total", total);
+}
+
+// Fill in one bp_access
 //
+static void
+set_access(bp_access *a, const char *table, uint32_t entries, uint32_t index,
+           const uint8_t *counters)
+{
+  a->table = table;
+  a->entries = entries;
+  a->index = index;
+  a->counter = counters != NULL;
+  a->state = counters ? ctr2_get(counters, index) : 0;
+}
+
+int
+bp_accesses(bp_state *bp, uint32_t pc, bp_access *a)
+{
+  tour_lookup k;
+  switch (bp->cfg.bpType) {
+    case GSHARE:
+      set_access(&a[0], "gshare", 1u << bp->cfg.ghistoryBits,
+                 gshare_index_k(bp, pc, bp->cfg.ghistoryBits), bp->bht_gshare);
+      return 1;
+    case TOURNAMENT:
+      tournament_lookup_k(bp, pc, &k, bp->cfg.tour_historyBits, bp->cfg.lhistoryBits,
+                          bp->cfg.pcIndexBits);
+      // The chooser's counters pick a component rather than a
+      // direction, and local histories are no counters at all
+      set_access(&a[0], "global", TOUR_G_ENTRY(bp), k.g_index, bp->tour_g_bht);
+      set_access(&a[1], "choice", TOUR_C_ENTRY(bp), k.c_index, NULL);
+      set_access(&a[2], "local history", TOUR_L_ENTRY(bp), k.l_slot, NULL);
+      set_access(&a[3], "local pattern", my_pow2(TOUR_L_HISTORY(bp)), k.l_history,
+                 bp->tour_l_pattern);
+      return 4;
+    default:
+      return 0;
+  }
+}
+
 uint8_t
-make_prediction(uint32_t pc)
+bp_predict(bp_state *bp, uint32_t pc)
 {
+  return bp->kernel->predict(bp, pc);
+}
 
-  // Make a prediction based on the bpType
-  switch (bpType) {
+void
+bp_train(bp_state *bp, uint32_t pc, uint8_t outcome)
+{
+  bp->kernel->train(bp, pc, outcome);
+}
+
+void
+bp_update_history(bp_state *bp, uint32_t pc, uint8_t outcome)
+{
+  switch (bp->cfg.bpType) {
     case STATIC:
-      return TAKEN;
     case GSHARE:
-      return gshare_predict(pc);
+      bp->ghistory = (bp->ghistory << 1) | outcome;
+      break;
+    case TOURNAMENT: {
+      uint32_t slot = pc & ((1u << bp->cfg.pcIndexBits) - 1);
+      uint32_t history = field_get(bp->tour_l_history, slot, bp->cfg.lhistoryBits);
+      field_set(bp->tour_l_history, slot, bp->cfg.lhistoryBits, (history << 1) | outcome);
+      bp->tour_g_history = (bp->tour_g_history << 1) | outcome;
+      break;
+    }
+    case CUSTOM:
+      bp->tage_base_history = (bp->tage_base_history << 1) | outcome;
+      tage_push_history(bp, outcome);
+      break;
+    case PERCEPTRON:
+      perceptron_push(bp, outcome);
+      break;
+    default:
+      break;
+  }
+}
+
+void
+bp_destroy(bp_state *bp)
+{
+  if (!bp) {
+    return;
+  }
+
+  switch (bp->cfg.bpType) {
+    case STATIC:
+    case GSHARE:
+      cleanup_gshare(bp);
+      break;
     case TOURNAMENT:
-      return tournament_predict(pc);
+      cleanup_tournament(bp);
+      break;
     case CUSTOM:
-      return tage_predict(pc);
+      cleanup_tage(bp);
+      break;
+    case PERCEPTRON:
+      cleanup_perceptron(bp);
+      break;
     default:
       break;
   }
 
-  // If there is not a compatable bpType then return NOTTAKEN
-  return NOTTAKEN;
+  free(bp);
 }
 
-// Train the predictor the last executed branch at PC 'pc' and with
-// outcome 'outcome' (true indicates that the branch was taken, false
-// indicates that the branch was not taken)
+uint32_t
+bp_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+            uint8_t *prediction, int n)
+{
+  return bp->kernel->simulate(bp, pc, outcome, prediction, n);
+}
+
+// Parse up to 'max' ":"-separated counts of at most 'limit'
+// (bit counts: BP_MAX_BITS) following a spec name into 'fields'
+//
+// Returns the number parsed, or -1 on malformed input
 //
+static int
+parse_spec_fields(const char *p, int *fields, int max, long limit)
+{
+  int n = 0;
+  while (*p == ':') {
+    char *end;
+    long v = strtol(p + 1, &end, 10);
+    if (end == p + 1 || n == max || v < 1) {
+      return -1;
+    }
+    if (v > limit) {
+      fprintf(stderr, "%ld exceeds the supported maximum of %ld\n", v, limit);
+      return -1;
+    }
+    fields[n++] = (int)v;
+    p = end;
+  }
+  return *p ? -1 : n;
+}
+
+int
+bp_parse_config(const char *spec, bp_config *cfg)
+{
+  int fields[3];
+  int n;
+
+  if (!strcmp(spec, "static")) {
+    bp_default_config(cfg, STATIC);
+  } else if (!strncmp(spec, "gshare", 6)) {
+    bp_default_config(cfg, GSHARE);
+    if ((n = parse_spec_fields(spec + 6, fields, 1, BP_MAX_BITS)) < 0) {
+      return 0;
+    }
+    if (n > 0) cfg->ghistoryBits = fields[0];
+  } else if (!strncmp(spec, "tournament", 10)) {
+    bp_default_config(cfg, TOURNAMENT);
+    if ((n = parse_spec_fields(spec + 10, fields, 3, BP_MAX_BITS)) < 0) {
+      return 0;
+    }
+    if (n > 0) cfg->tour_historyBits = fields[0];
+    if (n > 1) cfg->lhistoryBits = fields[1];
+    if (n > 2) cfg->pcIndexBits = fields[2];
+  } else if (!strncmp(spec, "custom", 6)) {
+    bp_default_config(cfg, CUSTOM);
+    if ((n = parse_spec_fields(spec + 6, fields, 1, BP_MAX_BITS)) < 0) {
+      return 0;
+    }
+    if (n > 0) cfg->ghistoryBits = fields[0];
+  } else if (!strncmp(spec, "perceptron", 10)) {
+    bp_default_config(cfg, PERCEPTRON);
+    if ((n = parse_spec_fields(spec + 10, fields, 2, PERC_MAX_ENTRIES)) < 0) {
+      return 0;
+    }
+    if (n > 0) cfg->perc_historyLen = fields[0];
+    if (n > 1) cfg->perc_entries = fields[1];
+    return cfg->perc_historyLen <= PERC_MAX_HISTORY;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
 
 void
-train_predictor(uint32_t pc, uint8_t outcome)
+bp_format_config(const bp_config *cfg, char *buf, size_t size)
 {
+  switch (cfg->bpType) {
+    case GSHARE:
+      snprintf(buf, size, "gshare:%d", cfg->ghistoryBits);
+      break;
+    case TOURNAMENT:
+      snprintf(buf, size, "tournament:%d:%d:%d", cfg->tour_historyBits,
+               cfg->lhistoryBits, cfg->pcIndexBits);
+      break;
+    case CUSTOM:
+      snprintf(buf, size, "custom:%d", cfg->ghistoryBits);
+      break;
+    case PERCEPTRON:
+      snprintf(buf, size, "perceptron:%d:%d", cfg->perc_historyLen, cfg->perc_entries);
+      break;
+    default:
+      snprintf(buf, size, "static");
+      break;
+  }
+}
+
+//------------------------------------//
+//          State Snapshots           //
+//------------------------------------//
 
-  switch (bpType) {
+typedef struct bp_state_header {
+  char magic[4];
+  uint32_t version;
+  int32_t cfg[7];     // bpType and the six geometry fields
+  uint32_t pad;
+  uint64_t branches;
+  uint64_t payload;   // bytes of state after the header
+} bp_state_header;
+
+// Either writes each piece of state to 'out' or fills it from
+// 'in', so saving and loading walk the same list
+typedef struct state_io {
+  FILE *out;
+  const uint8_t *in;
+  size_t left;
+  size_t total;
+  int ok;
+} state_io;
+
+static void
+state_field(state_io *io, void *p, size_t size)
+{
+  io->total += size;
+  if (io->out) {
+    io->ok &= fwrite(p, 1, size, io->out) == size;
+  } else if (io->in) {
+    if (size > io->left) {
+      io->ok = 0;
+      return;
+    }
+    memcpy(p, io->in, size);
+    io->in += size;
+    io->left -= size;
+  }
+}
+
+// Every table and history register of 'bp', in snapshot order;
+// with neither 'out' nor 'in' set this only adds up the size
+static void
+state_walk(bp_state *bp, state_io *io)
+{
+  switch (bp->cfg.bpType) {
     case STATIC:
     case GSHARE:
-      return train_gshare(pc, outcome);
+      state_field(io, &bp->ghistory, sizeof(bp->ghistory));
+      state_field(io, bp->bht_gshare, ctr2_bytes(1u << bp->cfg.ghistoryBits));
+      break;
     case TOURNAMENT:
-      return tournament_train(pc, outcome);
+      state_field(io, &bp->tour_g_history, sizeof(bp->tour_g_history));
+      state_field(io, bp->tour_g_bht, ctr2_bytes(TOUR_G_ENTRY(bp)));
+      state_field(io, bp->tour_l_history,
+                  field_words(TOUR_L_ENTRY(bp), TOUR_L_HISTORY(bp)) * sizeof(uint64_t));
+      state_field(io, bp->tour_l_pattern, ctr2_bytes(my_pow2(TOUR_L_HISTORY(bp))));
+      state_field(io, bp->tour_c_choice, ctr2_bytes(TOUR_C_ENTRY(bp)));
+      break;
     case CUSTOM:
-      return tage_train(pc, outcome);
+      state_field(io, &bp->tage_base_history, sizeof(bp->tage_base_history));
+      state_field(io, bp->tage_base_gshare, ctr2_bytes(1u << bp->cfg.ghistoryBits));
+      state_field(io, bp->tage_g_history, sizeof(bp->tage_g_history));
+      state_field(io, &bp->tage_g_ptr, sizeof(bp->tage_g_ptr));
+      state_field(io, bp->tage_index_fold, sizeof(bp->tage_index_fold));
+      state_field(io, bp->tage_tag_fold, sizeof(bp->tage_tag_fold));
+      for (int i = 0; i < TAGE_COMP_NUM; i++) {
+        state_field(io, bp->tage_comp_list[i].entry, sizeof(bp->tage_comp_list[i].entry));
+      }
+      state_field(io, &bp->tage_use_alt, sizeof(bp->tage_use_alt));
+      state_field(io, &bp->tage_tick, sizeof(bp->tage_tick));
+      state_field(io, &bp->tage_seed, sizeof(bp->tage_seed));
+      break;
+    case PERCEPTRON:
+      state_field(io, bp->perc_weights, (size_t)bp->cfg.perc_entries * bp->perc_stride);
+      state_field(io, bp->perc_bias, bp->cfg.perc_entries);
+      state_field(io, bp->perc_history, bp->cfg.perc_historyLen + bp->perc_stride);
+      state_field(io, &bp->perc_pos, sizeof(bp->perc_pos));
+      break;
     default:
       break;
   }
-  
+}
+
+int
+bp_save_state(bp_state *bp, uint64_t branches, const char *path)
+{
+  bp_state_header hdr;
+  state_io io;
+
+  memset(&io, 0, sizeof(io));
+  state_walk(bp, &io);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, BP_STATE_MAGIC, 4);
+  hdr.version = BP_STATE_VERSION;
+  hdr.cfg[0] = bp->cfg.bpType;
+  hdr.cfg[1] = bp->cfg.ghistoryBits;
+  hdr.cfg[2] = bp->cfg.tour_historyBits;
+  hdr.cfg[3] = bp->cfg.lhistoryBits;
+  hdr.cfg[4] = bp->cfg.pcIndexBits;
+  hdr.cfg[5] = bp->cfg.perc_historyLen;
+  hdr.cfg[6] = bp->cfg.perc_entries;
+  hdr.branches = branches;
+  hdr.payload = io.total;
+
+  io.out = fopen(path, "wb");
+  if (!io.out) {
+    perror(path);
+    return 0;
+  }
+  io.ok = fwrite(&hdr, sizeof(hdr), 1, io.out) == 1;
+  state_walk(bp, &io);
+  if (fclose(io.out) != 0 || !io.ok) {
+    perror(path);
+    return 0;
+  }
+  return 1;
+}
+
+// The payload state_walk would cover for 'cfg', worked out from
+// the geometry alone so nothing is allocated for an unchecked one
+//
+static size_t
+state_bytes(const bp_config *cfg)
+{
+  bp_state *bp = NULL;  // only for sizeof
+
+  switch (cfg->bpType) {
+    case STATIC:
+    case GSHARE:
+      return sizeof(bp->ghistory) + ctr2_bytes(1u << cfg->ghistoryBits);
+    case TOURNAMENT:
+      return sizeof(bp->tour_g_history) + 2 * ctr2_bytes(my_pow2(cfg->tour_historyBits)) +
+             field_words(my_pow2(cfg->pcIndexBits), cfg->lhistoryBits) * sizeof(uint64_t) +
+             ctr2_bytes(my_pow2(cfg->lhistoryBits));
+    case CUSTOM:
+      return sizeof(bp->tage_base_history) + ctr2_bytes(1u << cfg->ghistoryBits) +
+             sizeof(bp->tage_g_history) + sizeof(bp->tage_g_ptr) +
+             sizeof(bp->tage_index_fold) + sizeof(bp->tage_tag_fold) +
+             TAGE_COMP_NUM * sizeof(bp->tage_comp_list[0].entry) +
+             sizeof(bp->tage_use_alt) + sizeof(bp->tage_tick) + sizeof(bp->tage_seed);
+    case PERCEPTRON: {
+      size_t stride = perc_stride(cfg->perc_historyLen);
+      return (size_t)cfg->perc_entries * stride + cfg->perc_entries +
+             cfg->perc_historyLen + stride + sizeof(bp->perc_pos);
+    }
+    default:
+      return 0;
+  }
+}
+
+bp_state *
+bp_load_state(const char *path, uint64_t *branches)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fileno(f), &st) == 0 && st.st_size >= (off_t)sizeof(bp_state_header)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  }
+  fclose(f);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: not a predictor snapshot\n", path);
+    return NULL;
+  }
+
+  bp_state_header hdr;
+  bp_config cfg;
+  bp_state *bp = NULL;
+  memcpy(&hdr, map, sizeof(hdr));
+  cfg.bpType = hdr.cfg[0];
+  cfg.ghistoryBits = hdr.cfg[1];
+  cfg.tour_historyBits = hdr.cfg[2];
+  cfg.lhistoryBits = hdr.cfg[3];
+  cfg.pcIndexBits = hdr.cfg[4];
+  cfg.perc_historyLen = hdr.cfg[5];
+  cfg.perc_entries = hdr.cfg[6];
+
+  int geometry_ok = cfg.bpType >= STATIC && cfg.bpType <= PERCEPTRON;
+  for (int i = 1; i < 5; i++) {
+    geometry_ok &= hdr.cfg[i] >= 1 && hdr.cfg[i] <= BP_MAX_BITS;
+  }
+  geometry_ok &= cfg.perc_historyLen >= 1 && cfg.perc_historyLen <= PERC_MAX_HISTORY &&
+                 cfg.perc_entries >= 1 && cfg.perc_entries <= PERC_MAX_ENTRIES;
+
+  if (memcmp(hdr.magic, BP_STATE_MAGIC, 4) || hdr.version != BP_STATE_VERSION) {
+    fprintf(stderr, "%s: not a version %d predictor snapshot\n", path, BP_STATE_VERSION);
+  } else if (!geometry_ok) {
+    fprintf(stderr, "%s: snapshot has an invalid predictor geometry\n", path);
+  } else if (hdr.payload != st.st_size - sizeof(hdr)) {
+    fprintf(stderr, "%s: truncated predictor snapshot\n", path);
+  } else if (hdr.payload != state_bytes(&cfg)) {
+    // The geometry sizes the tables, so it has to match the
+    // payload before any of them are allocated
+    fprintf(stderr, "%s: snapshot does not match its predictor geometry\n", path);
+  } else {
+    state_io io;
+    memset(&io, 0, sizeof(io));
+    bp = bp_create(&cfg);
+    io.in = (const uint8_t*)map + sizeof(hdr);
+    io.left = hdr.payload;
+    io.ok = 1;
+    state_walk(bp, &io);
+    *branches = hdr.branches;
+  }
+
+  munmap(map, st.st_size);
+  return bp;
+}
+
+uint64_t
+bp_storage_bits(const bp_config *cfg)
+{
+  uint64_t g = cfg->ghistoryBits;
+  uint64_t tg = cfg->tour_historyBits;
+  uint64_t l = cfg->lhistoryBits;
+  uint64_t i = cfg->pcIndexBits;
+
+  switch (cfg->bpType) {
+    case GSHARE:
+      return (2ull << g) + g;
+    case TOURNAMENT:
+      // global and choice tables, local histories and patterns
+      return (2ull << tg) + (2ull << tg) + (l << i) + (2ull << l) + tg;
+    case CUSTOM:
+      // base gshare, tagged components, global history, use-alt
+      return (2ull << g) + g +
+             (uint64_t)TAGE_COMP_NUM * TAGE_COMP_ENTRY * (TAGE_TAG_LEN + TAGE_CTR_BITS + TAGE_U_BITS) +
+             TAGE_G_HISTORY_LEN + TAGE_USE_ALT_BITS;
+    case PERCEPTRON:
+      // 8-bit weights plus bias per perceptron, global history
+      return (uint64_t)cfg->perc_entries * (cfg->perc_historyLen + 1) * 8 + cfg->perc_historyLen;
+    default:
+      return 0;
+  }
+}
+
+
+//------------------------------------//
+//      Global Predictor Wrappers     //
+//------------------------------------//
+
+// Initialize the predictor
+//
+void
+init_predictor()
+{
+  bp_config cfg;
+  bp_default_config(&cfg, bpType);
+  bp_destroy(global_bp);
+  global_bp = bp_create(&cfg);
+}
+
+// Make a prediction for conditional branch instruction at PC 'pc'
+// Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
+// indicates a prediction of not taken
+//
+uint8_t
+make_prediction(uint32_t pc)
+{
+  return bp_predict(global_bp, pc);
+}
+
+// Train the predictor the last executed branch at PC 'pc' and with
+// outcome 'outcome' (true indicates that the branch was taken, false
+// indicates that the branch was not taken)
+//
+
+void
+train_predictor(uint32_t pc, uint8_t outcome)
+{
+  bp_train(global_bp, pc, outcome);
+}
 
+void
+fast_forward_predictor(uint32_t pc, uint8_t outcome)
+{
+  bp_update_history(global_bp, pc, outcome);
+}
+
+uint32_t
+simulate_predictor(const uint32_t *pc, const uint8_t *outcome, uint8_t *prediction, int n)
+{
+  return bp_simulate(global_bp, pc, outcome, prediction, n);
+}
+
+void
+report_predictor_tables(FILE *out)
+{
+  bp_report_tables(global_bp, out);
+}
+
+int
+predictor_accesses(uint32_t pc, bp_access *a)
+{
+  return bp_accesses(global_bp, pc, a);
+}
+
+int
+save_predictor(uint64_t branches, const char *path)
+{
+  return bp_save_state(global_bp, branches, path);
+}
+
+int
+load_predictor(const char *path, uint64_t *branches)
+{
+  bp_state *bp = bp_load_state(path, branches);
+  if (!bp) {
+    return 0;
+  }
+  bp_destroy(global_bp);
+  global_bp = bp;
+  bpType = bp->cfg.bpType;
+  ghistoryBits = bp->cfg.ghistoryBits;
+  tour_historyBits = bp->cfg.tour_historyBits;
+  lhistoryBits = bp->cfg.lhistoryBits;
+  pcIndexBits = bp->cfg.pcIndexBits;
+  perceptronHistory = bp->cfg.perc_historyLen;
+  perceptronEntries = bp->cfg.perc_entries;
+  return 1;
 }
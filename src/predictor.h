@@ -9,6 +9,7 @@
 #ifndef PREDICTOR_H
 #define PREDICTOR_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -30,6 +31,7 @@ extern const char *email;
 #define GSHARE      1
 #define TOURNAMENT  2
 #define CUSTOM      3
+#define PERCEPTRON  4
 extern const char *bpName[];
 
 // Definitions for 2-bit counters
@@ -42,14 +44,152 @@ extern const char *bpName[];
 //      Predictor Configuration       //
 //------------------------------------//
 extern int ghistoryBits; // Number of bits used for Global History
+extern int tour_historyBits; // Number of bits used for Tournament Global History
 extern int lhistoryBits; // Number of bits used for Local History
 extern int pcIndexBits;  // Number of bits used for PC index
+extern int perceptronHistory; // Global history length of the perceptron
+extern int perceptronEntries; // Number of perceptrons
 extern int bpType;       // Branch Prediction Type
 extern int verbose;
 
+// Geometry of a single predictor instance
+typedef struct bp_config {
+  int bpType;
+  int ghistoryBits;
+  int tour_historyBits;
+  int lhistoryBits;
+  int pcIndexBits;
+  int perc_historyLen;
+  int perc_entries;
+} bp_config;
+
+// Widest table index or history bit count: indices are
+// uint32_t and 2-bit counter tables top out at 256MB there
+#define BP_MAX_BITS       30
+
+// Limits of the perceptron geometry
+#define PERC_MAX_HISTORY  1024
+#define PERC_MAX_ENTRIES  (1 << 20)
+
+// Tables and histories of a single predictor instance
+typedef struct bp_state bp_state;
+
+// Most table entries one prediction reads (see bp_accesses)
+#define BP_MAX_ACCESSES   4
+
+// One table entry a prediction reads
+typedef struct bp_access {
+  const char *table;  // as named by bp_report_tables
+  uint32_t entries;   // in that table
+  uint32_t index;
+  int counter;        // True if the entry is a 2-bit direction counter...
+  uint8_t state;      // ...holding this value
+} bp_access;
+
+//------------------------------------//
+//    Predictor Instance Prototypes   //
+//------------------------------------//
+//
+// Instances share no state, so any number of them can be
+// simulated in one process and on separate threads
+//
+
+// Fill 'cfg' with the global configuration above for type 'type'
+//
+void bp_default_config(bp_config *cfg, int type);
+
+// Allocate and initialize a predictor with geometry 'cfg'
+//
+bp_state *bp_create(const bp_config *cfg);
+
+// Predict / train one instance, as make_prediction/train_predictor
+//
+uint8_t bp_predict(bp_state *bp, uint32_t pc);
+void bp_train(bp_state *bp, uint32_t pc, uint8_t outcome);
+
+// Shift one branch into the history registers (global and, for
+// tournament, local) without touching any counter table
+//
+void bp_update_history(bp_state *bp, uint32_t pc, uint8_t outcome);
+
+// Free a predictor and all of its tables
+//
+void bp_destroy(bp_state *bp);
+
+// Print every table of 'bp' with its size in bytes and the
+// kind of pages behind it
+//
+void bp_report_tables(bp_state *bp, FILE *out);
+
+// List the entries a prediction for 'pc' reads from each table,
+// in the same table order for every branch; covers gshare and
+// tournament, whose tables are indexed without tags
+//
+// Returns the number of entries, 0 for the other schemes
+//
+int bp_accesses(bp_state *bp, uint32_t pc, bp_access *a);
+
+// Predict and train 'n' consecutive branches; with the whole
+// run in hand, large tables are prefetched ahead of use. The
+// predictions are stored in 'prediction' unless it is NULL
+//
+// Returns the number of mispredictions
+//
+uint32_t bp_simulate(bp_state *bp, const uint32_t *pc, const uint8_t *outcome,
+                     uint8_t *prediction, int n);
+
+// Parse a predictor spec such as "gshare:13",
+// "tournament:12:11:10" or "perceptron:128:256" (the --<type>
+// options without the dashes); omitted parameters keep their
+// defaults, bit counts may go up to BP_MAX_BITS
+//
+// Returns True if Successful
+//
+int bp_parse_config(const char *spec, bp_config *cfg);
+
+// Write the canonical spec of 'cfg' into 'buf'
+//
+void bp_format_config(const bp_config *cfg, char *buf, size_t size);
+
+//------------------------------------//
+//          State Snapshots           //
+//------------------------------------//
+//
+// A snapshot is a 56 byte header followed by every table and
+// history register of one predictor, in native byte order:
+//
+//   magic "BPST", version, the bp_config (7 x int32), padding,
+//   branches seen (u64), size of the tables that follow (u64)
+//
+#define BP_STATE_MAGIC    "BPST"
+#define BP_STATE_VERSION  2
+
+// Write the full state of 'bp', after 'branches' branches, to
+// 'path'
+//
+// Returns True if Successful
+//
+int bp_save_state(bp_state *bp, uint64_t branches, const char *path);
+
+// Map the snapshot at 'path' and rebuild the predictor it holds;
+// '*branches' receives the branch count it was saved at
+//
+// Returns the predictor, or NULL if the snapshot is unreadable
+//
+bp_state *bp_load_state(const char *path, uint64_t *branches);
+
+// Hardware storage of a predictor with geometry 'cfg' in bits:
+// its tables plus history registers
+//
+uint64_t bp_storage_bits(const bp_config *cfg);
+
 //------------------------------------//
 //    Predictor Function Prototypes   //
 //------------------------------------//
+//
+// These drive a single global instance built from the
+// configuration variables above
+//
 
 // Initialize the predictor
 //
@@ -67,4 +207,36 @@ uint8_t make_prediction(uint32_t pc);
 //
 void train_predictor(uint32_t pc, uint8_t outcome);
 
+// Advance only the history registers past a branch, as
+// bp_update_history; the cheap way to skip ahead while keeping
+// the histories right
+//
+void fast_forward_predictor(uint32_t pc, uint8_t outcome);
+
+// Predict and train 'n' consecutive branches, as bp_simulate
+//
+// Returns the number of mispredictions
+//
+uint32_t simulate_predictor(const uint32_t *pc, const uint8_t *outcome, uint8_t *prediction,
+                            int n);
+
+// Print the predictor's tables, as bp_report_tables
+//
+void report_predictor_tables(FILE *out);
+
+// List the entries a prediction for 'pc' reads, as bp_accesses
+//
+// Returns the number of entries
+//
+int predictor_accesses(uint32_t pc, bp_access *a);
+
+// Snapshot the predictor after 'branches' branches / replace it
+// with a snapshot, as bp_save_state / bp_load_state; loading
+// also sets bpType and the geometry variables
+//
+// Returns True if Successful
+//
+int save_predictor(uint64_t branches, const char *path);
+int load_predictor(const char *path, uint64_t *branches);
+
 #endif
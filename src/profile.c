@@ -0,0 +1,131 @@
+//========================================================//
+//  profile.c                                             //
+//  Source file for the per-PC misprediction profiler     //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#define PROFILE_INITIAL_BITS  12
+
+static inline uint32_t
+profile_hash(uint32_t pc)
+{
+  // Fibonacci hashing spreads word-aligned PCs across the table
+  return pc * 0x9E3779B1u;
+}
+
+// Find the slot for 'pc' (possibly empty) by linear probing
+//
+static inline profile_entry *
+profile_slot(profile_entry *slots, uint32_t mask, uint32_t pc)
+{
+  uint32_t i = profile_hash(pc) & mask;
+  while (slots[i].executions && slots[i].pc != pc) {
+    i = (i + 1) & mask;
+  }
+  return &slots[i];
+}
+
+// Double the table once it is half full
+//
+static void
+profile_grow(profile *p)
+{
+  uint32_t size = (p->mask + 1) * 2;
+  profile_entry *slots = (profile_entry*)calloc(size, sizeof(profile_entry));
+
+  for (uint32_t i = 0; i <= p->mask; i++) {
+    if (p->slots[i].executions) {
+      *profile_slot(slots, size - 1, p->slots[i].pc) = p->slots[i];
+    }
+  }
+
+  free(p->slots);
+  p->slots = slots;
+  p->mask = size - 1;
+}
+
+profile *
+profile_create()
+{
+  profile *p = (profile*)calloc(1, sizeof(profile));
+  p->mask = (1u << PROFILE_INITIAL_BITS) - 1;
+  p->slots = (profile_entry*)calloc(p->mask + 1, sizeof(profile_entry));
+  return p;
+}
+
+void
+profile_record(profile *p, uint32_t pc, uint8_t outcome, uint8_t prediction)
+{
+  profile_entry *e = profile_slot(p->slots, p->mask, pc);
+
+  // Grow before claiming the slot: profile_grow only moves
+  // entries that have executions
+  if (!e->executions) {
+    if (++p->used * 2 > p->mask + 1) {
+      profile_grow(p);
+      e = profile_slot(p->slots, p->mask, pc);
+    }
+    e->pc = pc;
+  }
+
+  e->executions++;
+  e->taken += outcome;
+  e->mispredictions += (outcome != prediction);
+  p->mispredictions += (outcome != prediction);
+}
+
+static int
+by_mispredictions(const void *a, const void *b)
+{
+  const profile_entry *x = (const profile_entry*)a;
+  const profile_entry *y = (const profile_entry*)b;
+  if (x->mispredictions != y->mispredictions) {
+    return x->mispredictions < y->mispredictions ? 1 : -1;
+  }
+  return x->pc < y->pc ? -1 : (x->pc > y->pc);
+}
+
+void
+profile_report(const profile *p, int top, FILE *out)
+{
+  profile_entry *sorted = (profile_entry*)malloc((p->used + 1) * sizeof(profile_entry));
+  uint32_t n = 0;
+
+  for (uint32_t i = 0; i <= p->mask; i++) {
+    if (p->slots[i].executions) {
+      sorted[n++] = p->slots[i];
+    }
+  }
+  qsort(sorted, n, sizeof(profile_entry), by_mispredictions);
+
+  fprintf(out, "Static branches: %10u\n", n);
+  fprintf(out, "Top %d branches by mispredictions:\n", top);
+  fprintf(out, "%4s %12s %12s %12s %8s %8s %8s %8s\n", "Rank", "PC", "Executed",
+          "Incorrect", "Rate", "Taken", "Share", "Cumul");
+
+  double cumulative = 0;
+  for (uint32_t i = 0; i < n && i < (uint32_t)top; i++) {
+    const profile_entry *e = &sorted[i];
+    if (!e->mispredictions) {
+      break;
+    }
+    double share = p->mispredictions ? 100.0 * e->mispredictions / p->mispredictions : 0.0;
+    cumulative += share;
+    fprintf(out, "%4u %#12x %12llu %12llu %8.3f %8.3f %8.3f %8.3f\n", i + 1, e->pc,
+            (unsigned long long)e->executions, (unsigned long long)e->mispredictions,
+            100.0 * e->mispredictions / e->executions,
+            100.0 * e->taken / e->executions, share, cumulative);
+  }
+
+  free(sorted);
+}
+
+void
+profile_destroy(profile *p)
+{
+  free(p->slots);
+  free(p);
+}
@@ -0,0 +1,47 @@
+//========================================================//
+//  profile.h                                             //
+//  Header file for the per-PC misprediction profiler     //
+//                                                        //
+//  Counts executions, mispredictions and taken outcomes  //
+//  per static branch in an open-addressing hash table    //
+//========================================================//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PROFILE_DEFAULT_TOP  20
+
+typedef struct profile_entry {
+  uint64_t executions;  // 0 marks an empty slot
+  uint64_t mispredictions;
+  uint64_t taken;
+  uint32_t pc;
+} profile_entry;
+
+typedef struct profile {
+  profile_entry *slots;
+  uint32_t mask;      // slot count - 1, slot count is a power of 2
+  uint32_t used;
+  uint64_t mispredictions;
+} profile;
+
+// Allocate an empty profile
+//
+profile *profile_create();
+
+// Record one branch and the prediction made for it
+//
+void profile_record(profile *p, uint32_t pc, uint8_t outcome, uint8_t prediction);
+
+// Print the 'top' PCs with the most mispredictions
+//
+void profile_report(const profile *p, int top, FILE *out);
+
+// Free the profile
+//
+void profile_destroy(profile *p);
+
+#endif
@@ -0,0 +1,97 @@
+//========================================================//
+//  sample.c                                              //
+//  Source file for sampled simulation                    //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sample.h"
+
+static const char *warmingName[] = { "functional", "history" };
+
+int
+sample_parse(const char *spec, sample_plan *plan)
+{
+  char *end;
+  plan->period = strtoull(spec, &end, 10);
+  if (end == spec || *end != ':') {
+    return 0;
+  }
+  const char *p = end + 1;
+  plan->interval = strtoull(p, &end, 10);
+  if (end == p) {
+    return 0;
+  }
+  plan->warmup = plan->interval;
+  if (*end == ':') {
+    p = end + 1;
+    plan->warmup = strtoull(p, &end, 10);
+    if (end == p) {
+      return 0;
+    }
+  }
+  return !*end && plan->interval > 0 &&
+         plan->warmup + plan->interval <= plan->period;
+}
+
+int
+sample_warming(const char *name)
+{
+  for (int i = 0; i < 2; i++) {
+    if (!strcmp(name, warmingName[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void
+sample_add(sample_stats *s, const sample_plan *plan, uint32_t mispredictions)
+{
+  double rate = (double)mispredictions / plan->interval;
+  double delta = rate - s->mean;
+  s->samples++;
+  s->mispredictions += mispredictions;
+  s->mean += delta / s->samples;
+  s->m2 += delta * (rate - s->mean);
+}
+
+void
+sample_report(const sample_stats *s, const sample_plan *plan,
+              uint64_t branches, FILE *out)
+{
+  uint64_t measured = s->samples * plan->interval;
+
+  fprintf(out, "Branches:        %10llu\n", (unsigned long long)branches);
+  fprintf(out, "Sampled:         %10llu x %llu branches every %llu, %s warming",
+          (unsigned long long)s->samples, (unsigned long long)plan->interval,
+          (unsigned long long)plan->period, warmingName[plan->warming]);
+  if (plan->warming == SAMPLE_HISTORY) {
+    fprintf(out, " + %llu", (unsigned long long)plan->warmup);
+  }
+  fprintf(out, "\n");
+  fprintf(out, "Measured:        %10llu (%.3f%% of the trace)\n", (unsigned long long)measured,
+          branches ? 100.0 * measured / branches : 0.0);
+  fprintf(out, "Incorrect:       %10llu\n", (unsigned long long)s->mispredictions);
+  fprintf(out, "Misprediction Rate: %7.3f\n", 100.0 * s->mean);
+
+  // The per-sample rates are the observations; their spread
+  // gives the standard error of the mean
+  if (s->samples < 2) {
+    fprintf(out, "95%% Confidence:  too few samples\n");
+    return;
+  }
+  double stddev = sqrt(s->m2 / (s->samples - 1));
+  double half = SAMPLE_CONFIDENCE_Z * stddev / sqrt((double)s->samples);
+  fprintf(out, "95%% Confidence:  +-%.3f (%.3f - %.3f)\n", 100.0 * half,
+          100.0 * (s->mean - half), 100.0 * (s->mean + half));
+
+  // Samples needed for SAMPLE_TARGET_ERROR relative error, from
+  // the coefficient of variation measured so far
+  if (s->mean > 0) {
+    double cv = stddev / s->mean;
+    double needed = ceil(pow(SAMPLE_CONFIDENCE_Z * cv / SAMPLE_TARGET_ERROR, 2));
+    fprintf(out, "Samples for +-%.0f%%: %8.0f\n", 100 * SAMPLE_TARGET_ERROR, needed);
+  }
+}
@@ -0,0 +1,62 @@
+//========================================================//
+//  sample.h                                              //
+//  Header file for sampled simulation                    //
+//                                                        //
+//  SMARTS-style: the trace is cut into periods, and only //
+//  a short interval at the end of each is measured. The  //
+//  rest is fast-forwarded, either training the tables    //
+//  (functional warming) or shifting only the histories,  //
+//  then training over a warmup before the interval       //
+//========================================================//
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// How branches between samples are fast-forwarded
+#define SAMPLE_FUNCTIONAL  0 // train the predictor, predict nothing
+#define SAMPLE_HISTORY     1 // update the history registers only
+
+#define SAMPLE_CONFIDENCE_Z   1.96  // 95% two-sided, normal approximation
+#define SAMPLE_TARGET_ERROR   0.03  // relative error the sample count advice aims for
+
+typedef struct sample_plan {
+  uint64_t period;    // branches from one sample to the next
+  uint64_t interval;  // branches measured per sample
+  uint64_t warmup;    // branches trained on right before each sample
+  int warming;        // SAMPLE_FUNCTIONAL or SAMPLE_HISTORY
+} sample_plan;
+
+typedef struct sample_stats {
+  uint64_t samples;
+  uint64_t mispredictions;
+  double mean;  // running mean of the per-sample rates
+  double m2;    // and sum of squared deviations (Welford)
+} sample_stats;
+
+// Parse "<period>:<interval>[:<warmup>]" into 'plan'; the
+// warmup defaults to one interval
+//
+// Returns True if Successful
+//
+int sample_parse(const char *spec, sample_plan *plan);
+
+// Parse a warming mode name, "functional" or "history"
+//
+// Returns the mode, or -1 if unknown
+//
+int sample_warming(const char *name);
+
+// Record one sample of 'plan->interval' branches
+//
+void sample_add(sample_stats *s, const sample_plan *plan, uint32_t mispredictions);
+
+// Print the estimated misprediction rate and its confidence
+// interval for a trace of 'branches' branches
+//
+void sample_report(const sample_stats *s, const sample_plan *plan,
+                   uint64_t branches, FILE *out);
+
+#endif
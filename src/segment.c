@@ -0,0 +1,137 @@
+//========================================================//
+//  segment.c                                             //
+//  Source file for segmented parallel simulation         //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include "segment.h"
+#include "trace.h"
+#include "pool.h"
+
+// Branches handed to bp_simulate at a time
+#define SEGMENT_CHUNK  (1 << 20)
+
+typedef struct segment_job {
+  const trace_data *d;
+  bp_config cfg;
+  uint64_t warm;      // first branch trained on
+  uint64_t start;     // first branch counted
+  uint64_t head;      // end of the window compared with the previous segment
+  uint64_t end;       // end of the segment
+  uint64_t overrun;   // end of the window run on past the segment
+  uint64_t mispredictions;
+  uint64_t head_mispredictions;
+  uint64_t overrun_mispredictions;
+} segment_job;
+
+// Mispredictions over branches [from, to) of 'd'
+//
+static uint64_t
+simulate_range(bp_state *bp, const trace_data *d, uint64_t from, uint64_t to)
+{
+  uint64_t mispredictions = 0;
+  for (uint64_t pos = from; pos < to; pos += SEGMENT_CHUNK) {
+    uint64_t left = to - pos;
+    int n = left < SEGMENT_CHUNK ? (int)left : SEGMENT_CHUNK;
+    mispredictions += bp_simulate(bp, d->pc + pos, d->outcome + pos, NULL, n);
+  }
+  return mispredictions;
+}
+
+static void
+simulate_segment(void *arg)
+{
+  segment_job *job = (segment_job*)arg;
+  bp_state *bp = bp_create(&job->cfg);
+
+  // warmup predictions are made but not counted
+  simulate_range(bp, job->d, job->warm, job->start);
+  job->head_mispredictions = simulate_range(bp, job->d, job->start, job->head);
+  job->mispredictions = job->head_mispredictions +
+                        simulate_range(bp, job->d, job->head, job->end);
+  job->overrun_mispredictions = simulate_range(bp, job->d, job->end, job->overrun);
+
+  bp_destroy(bp);
+}
+
+int
+segment_run(const char *path, const bp_config *cfg, int nsegments,
+            uint64_t warmup, int nthreads, segment_result *res)
+{
+  trace_data d;
+  memset(res, 0, sizeof(*res));
+  if (!trace_load(path, &d)) {
+    return 0;
+  }
+  // a predictor keeps diverging from the serial one well past
+  // its warmup, so the cold start is compared over several
+  uint64_t check = warmup * SEGMENT_CHECK_RATIO;
+  if (check < SEGMENT_MIN_CHECK) {
+    check = SEGMENT_MIN_CHECK;
+  }
+  if ((uint64_t)nsegments > d.count) {
+    nsegments = d.count > 0 ? (int)d.count : 1;
+  }
+
+  segment_job *jobs = (segment_job*)calloc(nsegments, sizeof(segment_job));
+  for (int k = 0; k < nsegments; k++) {
+    segment_job *job = &jobs[k];
+    job->d = &d;
+    job->cfg = *cfg;
+    job->start = d.count * k / nsegments;
+    job->end = d.count * (k + 1) / nsegments;
+    job->warm = job->start > warmup ? job->start - warmup : 0;
+    job->head = job->start;
+    if (k > 0) {
+      job->head += job->end - job->start < check ? job->end - job->start : check;
+    }
+  }
+  // each segment runs on over the next one's compared window
+  for (int k = 0; k + 1 < nsegments; k++) {
+    jobs[k].overrun = jobs[k + 1].head;
+  }
+  jobs[nsegments - 1].overrun = jobs[nsegments - 1].end;
+
+  pool *p = pool_create(nthreads);
+  for (int k = 0; k < nsegments; k++) {
+    pool_submit(p, simulate_segment, &jobs[k]);
+  }
+  pool_wait(p);
+  pool_destroy(p);
+
+  res->nsegments = nsegments;
+  res->warmup = warmup;
+  res->check = check;
+  res->branches = d.count;
+  for (int k = 0; k < nsegments; k++) {
+    res->mispredictions += jobs[k].mispredictions;
+    res->head_mispredictions += jobs[k].head_mispredictions;
+    res->overrun_mispredictions += jobs[k].overrun_mispredictions;
+  }
+
+  free(jobs);
+  trace_free(&d);
+  return 1;
+}
+
+void
+segment_report(const segment_result *res, FILE *out)
+{
+  double rate = res->branches ? 100.0 * res->mispredictions / res->branches : 0.0;
+
+  // A segment's cold start shows up as mispredictions its
+  // warmed-up predecessor does not make on the same branches.
+  // The predecessor carries some cold start of its own and the
+  // segments keep drifting after the window, so this tends to
+  // undercount the difference from the serial run
+  int64_t error = (int64_t)res->head_mispredictions - (int64_t)res->overrun_mispredictions;
+  double error_rate = res->branches ? 100.0 * error / res->branches : 0.0;
+
+  fprintf(out, "Branches:        %10llu\n", (unsigned long long)res->branches);
+  fprintf(out, "Incorrect:       %10llu\n", (unsigned long long)res->mispredictions);
+  fprintf(out, "Misprediction Rate: %7.3f\n", rate);
+  fprintf(out, "Segments:        %10d (warmup %llu, checked over %llu branches)\n",
+          res->nsegments, (unsigned long long)res->warmup, (unsigned long long)res->check);
+  fprintf(out, "Est. serial error: %+8lld mispredictions (%+.4f%%)\n", (long long)error, error_rate);
+}
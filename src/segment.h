@@ -0,0 +1,50 @@
+//========================================================//
+//  segment.h                                             //
+//  Header file for segmented parallel simulation         //
+//                                                        //
+//  One trace is cut into segments simulated on separate  //
+//  threads. Each segment first trains (without counting) //
+//  on the branches before it, and runs on past its end   //
+//  so the next segment's cold start can be measured      //
+//  against a warm predictor                              //
+//========================================================//
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "predictor.h"
+
+#define SEGMENT_DEFAULT_WARMUP  (1 << 18) // branches trained on before a segment
+#define SEGMENT_CHECK_RATIO     4         // cold start compared over this many warmups
+#define SEGMENT_MIN_CHECK       (1 << 18) // ...and over at least this many branches
+
+typedef struct segment_result {
+  int nsegments;
+  uint64_t warmup;
+  uint64_t check;
+  uint64_t branches;
+  uint64_t mispredictions;
+  // Over the first 'check' counted branches of segments 1..n-1:
+  // mispredictions of the segment itself, and of the previous
+  // segment running on over the same branches
+  uint64_t head_mispredictions;
+  uint64_t overrun_mispredictions;
+} segment_result;
+
+// Simulate the trace at 'path' (stdin if NULL) with 'cfg' in
+// 'nsegments' segments on 'nthreads' workers, each segment
+// trained on the 'warmup' branches before it
+//
+// Returns True if Successful
+//
+int segment_run(const char *path, const bp_config *cfg, int nsegments,
+                uint64_t warmup, int nthreads, segment_result *res);
+
+// Print the merged result and the estimated difference from
+// a serial run
+//
+void segment_report(const segment_result *res, FILE *out);
+
+#endif
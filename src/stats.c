@@ -0,0 +1,159 @@
+//========================================================//
+//  stats.c                                               //
+//  Source file for hot-path timing statistics            //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <sys/resource.h>
+#include "stats.h"
+
+static const char *phaseName[NUM_PHASES] = { "read", "predict", "train", "simulate" };
+
+// Pick the next branch to time, on average STATS_SAMPLE_PERIOD
+// branches after the current one
+//
+static void
+schedule_sample(run_stats *s)
+{
+  s->seed ^= s->seed << 13;
+  s->seed ^= s->seed >> 17;
+  s->seed ^= s->seed << 5;
+  s->next_sample += 1 + s->seed % (2 * STATS_SAMPLE_PERIOD - 1);
+}
+
+static double
+seconds_between(const struct timespec *a, const struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+long
+stats_peak_rss_kb()
+{
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+  return ru.ru_maxrss;
+}
+
+void
+stats_start(run_stats *s)
+{
+  *s = (run_stats){ 0 };
+
+  // Cost of timing nothing, subtracted from every sample
+  uint64_t best = ~0ull;
+  for (int i = 0; i < 64; i++) {
+    uint64_t a = stats_ticks();
+    uint64_t b = stats_ticks();
+    if (b - a < best) {
+      best = b - a;
+    }
+  }
+  s->overhead = best;
+  s->seed = 0x9E3779B9u;
+  schedule_sample(s);
+
+  clock_gettime(CLOCK_MONOTONIC, &s->start);
+  s->batch_start = s->start;
+  s->start_ticks = stats_ticks();
+}
+
+void
+stats_sample(run_stats *s, uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3,
+             uint64_t wait)
+{
+  uint64_t t[PHASE_SIMULATE + 1] = { t0 + wait, t1, t2, t3 };
+  for (int p = 0; p < PHASE_SIMULATE; p++) {
+    uint64_t d = t[p + 1] - t[p];
+    s->phase_ticks[p] += d > s->overhead ? d - s->overhead : 0;
+  }
+  s->samples++;
+  schedule_sample(s);
+}
+
+void
+stats_sample_batch(run_stats *s, uint64_t t0, uint64_t t1, uint64_t t2, uint32_t n,
+                   uint64_t wait)
+{
+  uint64_t read = t1 - t0;
+  s->phase_ticks[PHASE_READ] += read > wait ? read - wait : 0;
+  s->phase_ticks[PHASE_SIMULATE] += t2 - t1;
+  s->samples += n;
+  s->batched = 1;
+}
+
+void
+stats_batch(run_stats *s)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double secs = seconds_between(&s->batch_start, &now);
+  double rate = secs > 0 ? STATS_BATCH / secs : 0;
+
+  if (s->batches == 0 || rate < s->batch_min) {
+    s->batch_min = rate;
+  }
+  if (rate > s->batch_max) {
+    s->batch_max = rate;
+  }
+  s->batches++;
+  s->batch_start = now;
+}
+
+void
+stats_finish(run_stats *s, uint64_t branches, uint64_t wait_ticks)
+{
+  struct timespec end;
+  uint64_t ticks = stats_ticks() - s->start_ticks;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  s->elapsed = seconds_between(&s->start, &end);
+  s->ns_per_tick = ticks ? s->elapsed * 1e9 / ticks : 0;
+  s->branches = branches;
+  s->wait_ticks = wait_ticks;
+  s->peak_rss_kb = stats_peak_rss_kb();
+}
+
+void
+stats_report(const run_stats *s, FILE *out)
+{
+  double total_ns = s->branches ? s->elapsed * 1e9 / s->branches : 0;
+  double phase_ns[NUM_PHASES];
+  double wait_ns = s->branches ? s->wait_ticks * s->ns_per_tick / s->branches : 0;
+  double sampled = wait_ns;
+
+  int shown[NUM_PHASES];
+  for (int p = 0; p < NUM_PHASES; p++) {
+    shown[p] = p == PHASE_READ || (p == PHASE_SIMULATE) == s->batched;
+    phase_ns[p] = s->samples ? s->phase_ticks[p] * s->ns_per_tick / s->samples : 0;
+    sampled += phase_ns[p];
+  }
+
+  // Timing a phase on its own stops it overlapping with its
+  // neighbours, so sampled latencies can add up to more than
+  // the wall time per branch; shares are of their sum
+  fprintf(out, "Phase          ns/branch    Share\n");
+  for (int p = 0; p < NUM_PHASES; p++) {
+    if (!shown[p]) {
+      continue;
+    }
+    fprintf(out, "%-12s %11.2f %7.1f%%\n", phaseName[p], phase_ns[p],
+            sampled > 0 ? 100 * phase_ns[p] / sampled : 0);
+  }
+  if (s->wait_ticks) {
+    fprintf(out, "%-12s %11.2f %7.1f%%\n", "decode wait", wait_ns,
+            sampled > 0 ? 100 * wait_ns / sampled : 0);
+  }
+  fprintf(out, "%-12s %11.2f\n", "wall", total_ns);
+
+  fprintf(out, "Elapsed:         %10.3f s\n", s->elapsed);
+  fprintf(out, "Throughput:      %10.3f Mbranches/s\n",
+          s->elapsed > 0 ? s->branches / s->elapsed / 1e6 : 0);
+  if (s->batches > 0) {
+    fprintf(out, "Batch range:     %10.3f - %.3f Mbranches/s over %llu batches\n",
+            s->batch_min / 1e6, s->batch_max / 1e6, (unsigned long long)s->batches);
+  }
+  fprintf(out, "Peak RSS:        %10ld KB\n", s->peak_rss_kb);
+}
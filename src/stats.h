@@ -0,0 +1,112 @@
+//========================================================//
+//  stats.h                                               //
+//  Header file for hot-path timing statistics            //
+//                                                        //
+//  On average one branch in every STATS_SAMPLE_PERIOD    //
+//  has its read, predict and train phases timed with the //
+//  cycle counter and the samples are scaled to the whole //
+//  run, so the instrumentation stays cheap enough to     //
+//  leave on. Sample gaps are randomised so they cannot   //
+//  alias with batch boundaries in the trace readers      //
+//========================================================//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define STATS_SAMPLE_PERIOD  64        // mean distance between timed branches
+#define STATS_BATCH          (1 << 20) // branches per throughput batch, power of 2
+
+// Phases of one simulated branch; a batched run times whole
+// batches and cannot split their predict and train
+#define PHASE_READ      0
+#define PHASE_PREDICT   1
+#define PHASE_TRAIN     2
+#define PHASE_SIMULATE  3 // predict and train, batched runs only
+#define NUM_PHASES      4
+
+typedef struct run_stats {
+  struct timespec start;
+  struct timespec batch_start;
+  uint64_t start_ticks;
+  uint64_t overhead;             // ticks of an empty timed interval
+  uint64_t phase_ticks[NUM_PHASES];
+  uint64_t wait_ticks;
+  uint64_t samples;              // timed branches
+  int batched;                   // timed by stats_sample_batch
+  uint64_t next_sample;          // number of the next branch to time
+  uint32_t seed;
+  uint64_t batches;
+  double batch_min;              // branches per second over one batch
+  double batch_max;
+  double elapsed;                // seconds, set by stats_finish
+  double ns_per_tick;
+  uint64_t branches;
+  long peak_rss_kb;
+} run_stats;
+
+// Timestamp in cycle counter ticks
+//
+static inline uint64_t
+stats_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// True if branch number 'n' (counting from 1) is timed
+//
+static inline int
+stats_sampled(const run_stats *s, uint64_t n)
+{
+  return n == s->next_sample;
+}
+
+// Start timing a run
+//
+void stats_start(run_stats *s);
+
+// Account one timed branch: read in [t0, t1), predict in
+// [t1, t2) and train in [t2, t3). 'wait' ticks of the read
+// were spent blocked on a decoder thread; those are rare and
+// huge, so they are counted exactly instead (see stats_finish)
+//
+void stats_sample(run_stats *s, uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3,
+                  uint64_t wait);
+
+// Account a batch of 'n' branches, all timed: read in [t0, t1),
+// 'wait' ticks of which were spent blocked on a decoder thread,
+// then predicted and trained in [t1, t2)
+//
+void stats_sample_batch(run_stats *s, uint64_t t0, uint64_t t1, uint64_t t2, uint32_t n,
+                        uint64_t wait);
+
+// Close a throughput batch of STATS_BATCH branches
+//
+void stats_batch(run_stats *s);
+
+// Stop timing after 'branches' branches, 'wait_ticks' of which
+// the reader spent blocked on its decoder
+//
+void stats_finish(run_stats *s, uint64_t branches, uint64_t wait_ticks);
+
+// Print per-phase cost, throughput and peak memory
+//
+void stats_report(const run_stats *s, FILE *out);
+
+// Peak resident set size of the process so far
+//
+long stats_peak_rss_kb();
+
+#endif
@@ -0,0 +1,226 @@
+//========================================================//
+//  sweep.c                                               //
+//  Source file for multi-configuration sweeps            //
+//========================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include "sweep.h"
+#include "pool.h"
+
+// Branches handed to bp_simulate at a time, keeps the count
+// within an int on multi-billion branch traces
+#define SWEEP_CHUNK  (1 << 20)
+
+int
+sweep_parse(const char *list, sweep_point *points, int max)
+{
+  int n = 0;
+  const char *p = list;
+
+  while (*p) {
+    const char *end = strchr(p, ',');
+    size_t len = end ? (size_t)(end - p) : strlen(p);
+    char spec[SWEEP_NAME_LEN];
+
+    if (n == max || len == 0 || len >= sizeof(spec)) {
+      return 0;
+    }
+    memcpy(spec, p, len);
+    spec[len] = '\0';
+
+    sweep_point *pt = &points[n++];
+    memset(pt, 0, sizeof(*pt));
+    if (!bp_parse_config(spec, &pt->cfg)) {
+      fprintf(stderr, "Unrecognized predictor spec %s\n", spec);
+      return 0;
+    }
+    bp_format_config(&pt->cfg, pt->name, sizeof(pt->name));
+
+    p += len;
+    if (*p == ',') {
+      p++;
+    }
+  }
+
+  return n;
+}
+
+void
+sweep_run(trace_reader *t, sweep_point *points, int n)
+{
+  bp_state *bp[SWEEP_MAX_POINTS];
+  trace_batch *batch = (trace_batch*)malloc(sizeof(trace_batch));
+
+  for (int i = 0; i < n; i++) {
+    bp[i] = bp_create(&points[i].cfg);
+  }
+
+  // Each batch is decoded once and then replayed through every
+  // predictor while it is still hot in cache
+  while (trace_read_batch(t, batch) > 0) {
+    for (int i = 0; i < n; i++) {
+      points[i].mispredictions += bp_simulate(bp[i], batch->pc, batch->outcome, NULL, batch->n);
+      points[i].branches += batch->n;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    bp_destroy(bp[i]);
+  }
+  free(batch);
+}
+
+void
+sweep_print(const sweep_point *points, int n)
+{
+  printf("%-28s %12s %12s %10s\n", "Predictor", "Branches", "Incorrect", "Rate");
+  for (int i = 0; i < n; i++) {
+    const sweep_point *pt = &points[i];
+    double rate = pt->branches ? 100.0 * pt->mispredictions / pt->branches : 0.0;
+    printf("%-28s %12llu %12llu %10.3f\n", pt->name,
+           (unsigned long long)pt->branches,
+           (unsigned long long)pt->mispredictions, rate);
+  }
+}
+
+//------------------------------------//
+//          Parallel Engine           //
+//------------------------------------//
+
+typedef struct sweep_cell {
+  const trace_data *trace;
+  sweep_point *result;
+} sweep_cell;
+
+typedef struct sweep_trace_job {
+  pool *p;
+  const char *path;
+  trace_data data;
+  int ok;
+  sweep_cell *cells;  // this trace's row of the matrix
+  int npoints;
+} sweep_trace_job;
+
+// Simulate one (trace, config) cell
+//
+static void
+simulate_cell(void *arg)
+{
+  sweep_cell *cell = (sweep_cell*)arg;
+  const trace_data *d = cell->trace;
+  bp_state *bp = bp_create(&cell->result->cfg);
+
+  for (uint64_t pos = 0; pos < d->count; pos += SWEEP_CHUNK) {
+    uint64_t left = d->count - pos;
+    int n = left < SWEEP_CHUNK ? (int)left : SWEEP_CHUNK;
+    cell->result->mispredictions += bp_simulate(bp, d->pc + pos, d->outcome + pos, NULL, n);
+  }
+  cell->result->branches = d->count;
+
+  bp_destroy(bp);
+}
+
+// Decode one trace, then fan its row of cells out to the pool
+//
+static void
+decode_trace(void *arg)
+{
+  sweep_trace_job *job = (sweep_trace_job*)arg;
+
+  job->ok = trace_load(job->path, &job->data);
+  if (!job->ok) {
+    return;
+  }
+  for (int i = 0; i < job->npoints; i++) {
+    pool_submit(job->p, simulate_cell, &job->cells[i]);
+  }
+}
+
+int
+sweep_run_parallel(const char **traces, int ntraces,
+                   const sweep_point *points, int npoints,
+                   int nthreads, sweep_point *results)
+{
+  pool *p = pool_create(nthreads);
+  sweep_trace_job *jobs = (sweep_trace_job*)calloc(ntraces, sizeof(sweep_trace_job));
+  sweep_cell *cells = (sweep_cell*)calloc(ntraces * npoints, sizeof(sweep_cell));
+  int ok = 1;
+
+  for (int t = 0; t < ntraces; t++) {
+    sweep_trace_job *job = &jobs[t];
+    job->p = p;
+    job->path = traces[t];
+    job->cells = &cells[t * npoints];
+    job->npoints = npoints;
+    for (int i = 0; i < npoints; i++) {
+      sweep_point *r = &results[t * npoints + i];
+      *r = points[i];
+      r->branches = 0;
+      r->mispredictions = 0;
+      job->cells[i].trace = &job->data;
+      job->cells[i].result = r;
+    }
+    pool_submit(p, decode_trace, job);
+  }
+
+  pool_wait(p);
+  pool_destroy(p);
+
+  for (int t = 0; t < ntraces; t++) {
+    ok &= jobs[t].ok;
+    trace_free(&jobs[t].data);
+  }
+  free(cells);
+  free(jobs);
+  return ok;
+}
+
+// Short label for a trace path: its file name without extension
+//
+static void
+trace_label(const char *path, char *buf, size_t size)
+{
+  const char *base = path ? strrchr(path, '/') : NULL;
+  base = base ? base + 1 : (path ? path : "stdin");
+  snprintf(buf, size, "%s", base);
+  char *dot = strchr(buf, '.');
+  if (dot && dot != buf) {
+    *dot = '\0';
+  }
+}
+
+void
+sweep_print_matrix(const char **traces, int ntraces,
+                   const sweep_point *points, int npoints,
+                   const sweep_point *results)
+{
+  char label[32];
+
+  printf("%-12s %-28s %12s %12s %10s\n", "Trace", "Predictor", "Branches", "Incorrect", "Rate");
+  for (int t = 0; t < ntraces; t++) {
+    trace_label(traces[t], label, sizeof(label));
+    for (int i = 0; i < npoints; i++) {
+      const sweep_point *r = &results[t * npoints + i];
+      double rate = r->branches ? 100.0 * r->mispredictions / r->branches : 0.0;
+      printf("%-12s %-28s %12llu %12llu %10.3f\n", label, r->name,
+             (unsigned long long)r->branches,
+             (unsigned long long)r->mispredictions, rate);
+    }
+  }
+
+  if (ntraces < 2) {
+    return;
+  }
+  for (int i = 0; i < npoints; i++) {
+    uint64_t branches = 0;
+    uint64_t mispredictions = 0;
+    for (int t = 0; t < ntraces; t++) {
+      branches += results[t * npoints + i].branches;
+      mispredictions += results[t * npoints + i].mispredictions;
+    }
+    double rate = branches ? 100.0 * mispredictions / branches : 0.0;
+    printf("%-12s %-28s %12llu %12llu %10.3f\n", "(all)", points[i].name,
+           (unsigned long long)branches, (unsigned long long)mispredictions, rate);
+  }
+}
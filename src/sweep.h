@@ -0,0 +1,63 @@
+//========================================================//
+//  sweep.h                                               //
+//  Header file for multi-configuration sweeps            //
+//                                                        //
+//  A sweep reads the trace once and feeds every decoded  //
+//  batch to each configured predictor. The parallel      //
+//  engine spreads a (trace x config) matrix over a       //
+//  work-stealing thread pool instead                     //
+//========================================================//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include "predictor.h"
+#include "trace.h"
+
+#define SWEEP_MAX_POINTS  256
+#define SWEEP_MAX_TRACES  64
+#define SWEEP_NAME_LEN    48
+
+// One predictor configuration and its results
+typedef struct sweep_point {
+  char name[SWEEP_NAME_LEN];
+  bp_config cfg;
+  uint64_t branches;
+  uint64_t mispredictions;
+} sweep_point;
+
+// Parse a comma separated list of predictor specs
+// (e.g. "gshare:12,gshare:14,tournament:12:11:10")
+//
+// Returns the number of points, or 0 on malformed input
+//
+int sweep_parse(const char *list, sweep_point *points, int max);
+
+// Simulate every point over the whole trace
+//
+void sweep_run(trace_reader *t, sweep_point *points, int n);
+
+// Print one result row per point
+//
+void sweep_print(const sweep_point *points, int n);
+
+// Simulate every point over every trace on 'nthreads' workers.
+// Each trace is decoded once into memory and shared by all of
+// its simulations. 'results' receives ntraces * npoints cells,
+// trace-major
+//
+// Returns True if every trace could be read
+//
+int sweep_run_parallel(const char **traces, int ntraces,
+                       const sweep_point *points, int npoints,
+                       int nthreads, sweep_point *results);
+
+// Print the matrix filled by sweep_run_parallel, with a
+// combined row per point across all traces
+//
+void sweep_print_matrix(const char **traces, int ntraces,
+                        const sweep_point *points, int npoints,
+                        const sweep_point *results);
+
+#endif
@@ -0,0 +1,125 @@
+//========================================================//
+//  table.c                                               //
+//  Source file for predictor table allocation            //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "table.h"
+
+// Kept in the cache line in front of every table, so freeing
+// and reporting need nothing but the table pointer
+typedef struct table_header {
+  void *base;     // start of the malloc block or mapping
+  size_t mapped;  // length of the mapping, 0 for malloc
+  size_t bytes;   // as requested
+  int kind;
+} table_header;
+
+static const char *kindName[] = { "heap", "pages", "thp", "hugetlb" };
+
+static inline table_header *
+header_of(const void *t)
+{
+  return (table_header*)((uint8_t*)t - TABLE_ALIGN);
+}
+
+// Map 'len' bytes, on explicit huge pages if 'flags' asks
+//
+// Returns the mapping, or NULL
+//
+static void *
+map_pages(size_t len, int flags)
+{
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+void *
+table_alloc(size_t bytes, uint8_t fill)
+{
+  size_t len = bytes + TABLE_ALIGN;
+  table_header h = { NULL, 0, bytes, TABLE_HEAP };
+
+  if (bytes >= TABLE_HUGE_MIN) {
+    // An explicit pool is only there if the admin reserved one
+    // (vm.nr_hugepages); without it the mapping fails at once
+    size_t huge = (len + TABLE_HUGE_PAGE - 1) & ~(size_t)(TABLE_HUGE_PAGE - 1);
+#ifdef MAP_HUGETLB
+    if ((h.base = map_pages(huge, MAP_HUGETLB))) {
+      h.mapped = huge;
+      h.kind = TABLE_HUGETLB;
+    }
+#endif
+    // Otherwise over-map by a huge page to align the start, so
+    // the kernel can back every 2MB of the table with one page
+    if (!h.base && (h.base = map_pages(huge + TABLE_HUGE_PAGE, 0))) {
+      uintptr_t start = (uintptr_t)h.base;
+      uintptr_t aligned = (start + TABLE_HUGE_PAGE - 1) & ~(uintptr_t)(TABLE_HUGE_PAGE - 1);
+      if (aligned > start) {
+        munmap(h.base, aligned - start);
+      }
+      munmap((void*)(aligned + huge), start + TABLE_HUGE_PAGE - aligned);
+      h.base = (void*)aligned;
+      h.mapped = huge;
+#ifdef MADV_HUGEPAGE
+      h.kind = madvise(h.base, huge, MADV_HUGEPAGE) == 0 ? TABLE_THP : TABLE_PAGES;
+#else
+      h.kind = TABLE_PAGES;
+#endif
+    }
+  }
+
+  if (!h.base) {
+    if (posix_memalign(&h.base, TABLE_ALIGN, len)) {
+      fprintf(stderr, "Out of memory for a %zu byte table\n", bytes);
+      exit(1);
+    }
+    h.mapped = 0;
+    h.kind = TABLE_HEAP;
+  }
+
+  uint8_t *t = (uint8_t*)h.base + TABLE_ALIGN;
+  *header_of(t) = h;
+
+  // Fresh mappings read as zero and are only faulted in when
+  // touched, which a sparse limit-study table may never be
+  if (fill || h.kind == TABLE_HEAP) {
+    memset(t, fill, bytes);
+  }
+  return t;
+}
+
+void
+table_free(void *t)
+{
+  if (!t) {
+    return;
+  }
+  table_header *h = header_of(t);
+  if (h->mapped) {
+    munmap(h->base, h->mapped);
+  } else {
+    free(h->base);
+  }
+}
+
+size_t
+table_bytes(const void *t)
+{
+  return t ? header_of(t)->bytes : 0;
+}
+
+void
+table_report(const char *name, const void *t, FILE *out)
+{
+  if (!t) {
+    return;
+  }
+  const table_header *h = header_of(t);
+  fprintf(out, "  %-20s %14zu bytes  %s\n", name, h->bytes, kindName[h->kind]);
+}
@@ -0,0 +1,160 @@
+//========================================================//
+//  table.h                                               //
+//  Packed storage for predictor tables                   //
+//                                                        //
+//  2-bit counters are stored four to a byte and n-bit   //
+//  fields (e.g. local histories) back to back in 64 bit  //
+//  words, so tables take their real hardware size        //
+//========================================================//
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//------------------------------------//
+//          Table Allocation          //
+//------------------------------------//
+//
+// Tables of TABLE_HUGE_MIN bytes and up are mapped on huge
+// pages: explicit ones (MAP_HUGETLB) when the system reserved
+// a pool, else transparent ones (madvise), else plain pages.
+// Smaller tables come from the heap
+//
+
+#define TABLE_ALIGN      64          // tables start on a cache line
+#define TABLE_HUGE_PAGE  (2u << 20)
+#define TABLE_HUGE_MIN   TABLE_HUGE_PAGE
+
+// Where a table's memory came from
+#define TABLE_HEAP     0
+#define TABLE_PAGES    1 // mmap, base pages
+#define TABLE_THP      2 // mmap, advised for transparent huge pages
+#define TABLE_HUGETLB  3 // mmap, explicit huge pages
+
+// Allocate a table of 'bytes' bytes, every byte set to 'fill';
+// exits if memory runs out
+//
+void *table_alloc(size_t bytes, uint8_t fill);
+
+// Free a table from table_alloc (NULL is ignored)
+//
+void table_free(void *t);
+
+// Bytes requested for a table, 0 for NULL
+//
+size_t table_bytes(const void *t);
+
+// Print one line on table 't' under 'name': its size and
+// where its memory came from
+//
+void table_report(const char *name, const void *t, FILE *out);
+
+//------------------------------------//
+//        Packed 2-bit Counters       //
+//------------------------------------//
+
+// Bytes needed for 'entries' 2-bit counters
+//
+static inline size_t
+ctr2_bytes(uint32_t entries)
+{
+  return ((size_t)entries + 3) / 4;
+}
+
+// Allocate 'entries' counters, all set to 'init'; free with
+// table_free
+//
+static inline uint8_t *
+ctr2_alloc(uint32_t entries, uint8_t init)
+{
+  return (uint8_t*)table_alloc(ctr2_bytes(entries), (init & 3) * 0x55);
+}
+
+static inline uint8_t
+ctr2_get(const uint8_t *t, uint32_t i)
+{
+  return (t[i >> 2] >> ((i & 3) << 1)) & 3;
+}
+
+static inline void
+ctr2_set(uint8_t *t, uint32_t i, uint8_t v)
+{
+  int shift = (i & 3) << 1;
+  t[i >> 2] = (t[i >> 2] & ~(3 << shift)) | ((v & 3) << shift);
+}
+
+// Start fetching the line of counter 'i' for a later update
+//
+static inline void
+ctr2_prefetch(const uint8_t *t, uint32_t i)
+{
+  __builtin_prefetch(t + (i >> 2), 1);
+}
+
+//------------------------------------//
+//         Packed n-bit Fields        //
+//------------------------------------//
+//
+// Fields up to 32 bits wide; a field may straddle two words
+//
+
+// Words needed for 'entries' fields of 'width' bits, plus one
+// so a straddling read never runs off the end
+//
+static inline size_t
+field_words(uint32_t entries, int width)
+{
+  return ((size_t)entries * width + 63) / 64 + 1;
+}
+
+// Allocate 'entries' fields of 'width' bits, all zero; free
+// with table_free
+//
+static inline uint64_t *
+field_alloc(uint32_t entries, int width)
+{
+  return (uint64_t*)table_alloc(field_words(entries, width) * sizeof(uint64_t), 0);
+}
+
+static inline uint32_t
+field_get(const uint64_t *t, uint32_t i, int width)
+{
+  uint64_t bit = (uint64_t)i * width;
+  uint64_t word = bit >> 6;
+  int off = bit & 63;
+  uint64_t v = t[word] >> off;
+  if (off + width > 64) {
+    v |= t[word + 1] << (64 - off);
+  }
+  return (uint32_t)(v & ((1ull << width) - 1));
+}
+
+static inline void
+field_set(uint64_t *t, uint32_t i, int width, uint32_t v)
+{
+  uint64_t bit = (uint64_t)i * width;
+  uint64_t word = bit >> 6;
+  int off = bit & 63;
+  uint64_t mask = (1ull << width) - 1;
+  v &= mask;
+  t[word] = (t[word] & ~(mask << off)) | ((uint64_t)v << off);
+  if (off + width > 64) {
+    int spill = 64 - off;
+    t[word + 1] = (t[word + 1] & ~(mask >> spill)) | ((uint64_t)v >> spill);
+  }
+}
+
+// Start fetching the line of field 'i' (its first word) for a
+// later update
+//
+static inline void
+field_prefetch(const uint64_t *t, uint32_t i, int width)
+{
+  __builtin_prefetch(t + (((uint64_t)i * width) >> 6), 1);
+}
+
+#endif
@@ -0,0 +1,855 @@
+//========================================================//
+//  trace.c                                               //
+//  Source file for the branch trace readers              //
+//                                                        //
+//  Text traces are read in large blocks and parsed with  //
+//  SIMD, binary traces are mmapped and walked in place   //
+//  (columnar ones decoded from the mapping a batch at a  //
+//  time), and bzip2 traces are decoded on a background   //
+//  thread                                                //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+#include "trace.h"
+#include "stats.h"
+#include "column.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Size of the compressed-text chunks the decoder parses at a time
+#define BZ2_CHUNK  (1 << 16)
+
+// Check a header read from the start of a trace
+//
+static int
+is_binary_header(const uint8_t *data, size_t size)
+{
+  trace_header hdr;
+  if (size < TRACE_HEADER_SIZE) {
+    return 0;
+  }
+  memcpy(&hdr, data, TRACE_HEADER_SIZE);
+  return !memcmp(hdr.magic, TRACE_MAGIC, 4) && hdr.version == TRACE_VERSION;
+}
+
+// Point the reader at the records following a binary header
+//
+static int
+attach_records(trace_reader *t, const uint8_t *data, size_t size)
+{
+  trace_header hdr;
+  memcpy(&hdr, data, TRACE_HEADER_SIZE);
+
+  uint64_t avail = (size - TRACE_HEADER_SIZE) / TRACE_RECORD_SIZE;
+  if (hdr.count > avail) {
+    fprintf(stderr, "Truncated binary trace: header says %llu records, found %llu\n",
+            (unsigned long long)hdr.count, (unsigned long long)avail);
+    hdr.count = avail;
+  }
+
+  t->format = TRACE_BINARY;
+  t->records = data + TRACE_HEADER_SIZE;
+  t->count = hdr.count;
+  t->pos = 0;
+  return 1;
+}
+
+// Set up decoding of the columnar trace following a header
+//
+static int
+attach_columns(trace_reader *t, const uint8_t *data, size_t size)
+{
+  t->col = col_open(data, size, &t->count);
+  if (!t->col) {
+    return 0;
+  }
+  t->format = TRACE_COLUMNAR;
+  t->pos = 0;
+  return 1;
+}
+
+// Slurp a non-seekable binary stream (e.g. a pipe) into memory
+//
+static int
+read_binary_stream(trace_reader *t)
+{
+  size_t cap = 1 << 20;
+  size_t size = t->prefix_len;
+  uint8_t *data = (uint8_t*)malloc(cap);
+  size_t n;
+
+  memcpy(data, t->prefix, t->prefix_len);
+  while ((n = fread(data + size, 1, cap - size, t->stream)) > 0) {
+    size += n;
+    if (size == cap) {
+      cap *= 2;
+      data = (uint8_t*)realloc(data, cap);
+    }
+  }
+
+  t->map = data;
+  t->map_len = 0;
+  if (col_is_header(data, size)) {
+    return attach_columns(t, data, size);
+  }
+  if (!is_binary_header(data, size)) {
+    fprintf(stderr, "Unrecognized binary trace header\n");
+    return 0;
+  }
+  return attach_records(t, data, size);
+}
+
+//------------------------------------//
+//            Text Parsing            //
+//------------------------------------//
+//
+// Newlines are found 64 bytes at a time and each PC is
+// classified and converted 16 bytes at a time. Both may read
+// up to TRACE_TEXT_PAD bytes past the text they are given
+//
+
+// Bit i set if p[i] is a newline, for i < min(len, 64)
+//
+static inline uint64_t
+newline_mask(const char *p, size_t len)
+{
+  uint64_t mask = 0;
+#ifdef __SSE2__
+  __m128i nl = _mm_set1_epi8('\n');
+  for (int i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+    mask |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (16 * i);
+  }
+#else
+  for (int i = 0; i < 64; i++) {
+    mask |= (uint64_t)(p[i] == '\n') << i;
+  }
+#endif
+  if (len < 64) {
+    mask &= (1ull << len) - 1;
+  }
+  return mask;
+}
+
+// Value of the hex number starting at p (stopping at 'end'),
+// with *stop set just past it; only the low 32 bits of longer
+// numbers are kept
+//
+// A number ends at the first byte below '0' (the separator or
+// line end), with letters taken as hex digits
+//
+static inline uint32_t
+parse_hex(const char *p, const char *end, const char **stop)
+{
+  uint32_t value = 0;
+#ifdef __SSE2__
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i hex = _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1));
+  long len = __builtin_ctz(~(unsigned)_mm_movemask_epi8(hex));
+  if (len > end - p) {
+    len = end - p;
+  }
+
+  // Up to 8 digits: nibble values, paired into bytes in
+  // big-endian order, so the first four bytes hold the first
+  // 8 digits and whatever follows them is shifted out
+  if (len <= 8) {
+    __m128i alpha = _mm_cmpgt_epi8(v, _mm_set1_epi8('9'));
+    __m128i nib = _mm_add_epi8(_mm_and_si128(v, _mm_set1_epi8(0x0f)),
+                               _mm_and_si128(alpha, _mm_set1_epi8(9)));
+    nib = _mm_and_si128(nib, hex);
+    __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0x00ff)), 4),
+                                 _mm_srli_epi16(nib, 8));
+    __m128i bytes = _mm_packus_epi16(pairs, pairs);
+    value = __builtin_bswap32((uint32_t)_mm_cvtsi128_si32(bytes));
+    value = len ? value >> (32 - 4 * len) : 0;
+    *stop = p + len;
+    return value;
+  }
+#endif
+  for (; p < end && *p >= '0'; p++) {
+    uint8_t c = *p;
+    value = (value << 4) | ((c & 0x0f) + (c > '9' ? 9 : 0));
+  }
+  *stop = p;
+  return value;
+}
+
+// Parse one "0x<pc> <outcome>" line in [p, end)
+//
+static inline void
+parse_text_line(const char *p, const char *end, uint32_t *pc, uint8_t *outcome)
+{
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    p += 2;
+  }
+  *pc = parse_hex(p, end, &p);
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  *outcome = (p < end && *p == '1') ? 1 : 0;
+}
+
+// Parse the complete lines in the 'len' bytes at 'text' into
+// 'batch' until it is full; empty lines are skipped
+//
+// Newlines are located for a run of lines first and the lines
+// parsed afterwards, so neither loop waits on the other
+//
+// Returns the number of bytes consumed, always up to the end
+// of a line
+//
+static size_t
+parse_text_block(const char *text, size_t len, trace_batch *batch)
+{
+  uint32_t eol[TRACE_BATCH + 64];
+  size_t line = 0;  // start of the next line
+  size_t base = 0;  // next byte to look for newlines in
+  int n = batch->n;
+
+  while (n < TRACE_BATCH && base < len) {
+    // Offsets of the next (at least) TRACE_BATCH - n newlines
+    int lines = 0;
+    for (; base < len && lines < TRACE_BATCH - n; base += 64) {
+      uint64_t nl = newline_mask(text + base, len - base);
+      while (nl) {
+        eol[lines++] = base + __builtin_ctzll(nl);
+        nl &= nl - 1;
+      }
+    }
+
+    for (int i = 0; i < lines; i++) {
+      if (eol[i] > line) {
+        parse_text_line(text + line, text + eol[i], &batch->pc[n], &batch->outcome[n]);
+        if (++n == TRACE_BATCH) {
+          batch->n = n;
+          return eol[i] + 1;
+        }
+      }
+      line = eol[i] + 1;
+    }
+  }
+
+  batch->n = n;
+  return line;
+}
+
+// Read up to 'len' bytes of input: from a live feed whatever
+// has arrived, waiting only while nothing has, else a full block
+//
+// Returns the number of bytes read, 0 at the end of the input
+//
+static size_t
+read_input(trace_reader *t, char *buf, size_t len)
+{
+  if (!t->live) {
+    return fread(buf, 1, len, t->stream);
+  }
+  if (t->wait && !t->wait(t->wait_arg, t->fd)) {
+    return 0;
+  }
+  ssize_t n = read(t->fd, buf, len);
+  return n > 0 ? (size_t)n : 0;
+}
+
+// Refill the reader's parsed batch from the text stream
+//
+// Returns False at the end of the trace
+//
+static int
+next_text_batch(trace_reader *t)
+{
+  if (!t->text) {
+    t->text = (char*)calloc(TRACE_TEXT_BLOCK + 1 + TRACE_TEXT_PAD, 1);
+    t->parsed = (trace_batch*)malloc(sizeof(trace_batch));
+  }
+  trace_batch *batch = t->parsed;
+  batch->n = 0;
+
+  while (batch->n < TRACE_BATCH) {
+    t->text_pos += parse_text_block(t->text + t->text_pos, t->text_len - t->text_pos, batch);
+    if (batch->n == TRACE_BATCH || t->text_eof || (t->live && batch->n > 0)) {
+      break;
+    }
+
+    // Out of complete lines: keep the partial one and read on
+    size_t have = t->text_len - t->text_pos;
+    if (have == TRACE_TEXT_BLOCK) {
+      fprintf(stderr, "Trace line longer than %d bytes\n", TRACE_TEXT_BLOCK);
+      t->text_eof = 1;
+      break;
+    }
+    memmove(t->text, t->text + t->text_pos, have);
+    size_t n = read_input(t, t->text + have, TRACE_TEXT_BLOCK - have);
+    t->text_len = have + n;
+    t->text_pos = 0;
+    if (n == 0) {
+      // a last line without a newline still counts
+      t->text_eof = 1;
+      if (have > 0) {
+        t->text[t->text_len++] = '\n';
+      }
+    }
+  }
+
+  t->batch = batch;
+  t->batch_pos = 0;
+  return batch->n > 0;
+}
+
+//------------------------------------//
+//          bzip2 Decoding            //
+//------------------------------------//
+
+// Wait for the other side of the ring to make progress
+//
+static void
+ring_wait()
+{
+  sched_yield();
+}
+
+// Claim the next free slot for the decoder, NULL if the
+// reader has given up on the trace
+//
+static trace_batch *
+ring_claim(trace_ring *ring)
+{
+  unsigned head = ring->head;
+  while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SLOTS) {
+    if (__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+      return NULL;
+    }
+    ring_wait();
+  }
+  trace_batch *batch = &ring->slot[head & (TRACE_RING_SLOTS - 1)];
+  batch->n = 0;
+  return batch;
+}
+
+// Hand a filled slot over to the reader
+//
+static void
+ring_publish(trace_ring *ring)
+{
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Decoder thread: decompress, split into lines and publish
+// the parsed branches one batch at a time
+//
+static void *
+bz2_decoder(void *arg)
+{
+  trace_reader *t = (trace_reader*)arg;
+  trace_ring *ring = t->ring;
+  char *text = (char*)calloc(BZ2_CHUNK + 1 + TRACE_TEXT_PAD, 1);
+  int have = 0;
+  int bzerr;
+
+  BZFILE *bz = BZ2_bzReadOpen(&bzerr, t->stream, 0, 0, t->prefix, t->prefix_len);
+  trace_batch *batch = ring_claim(ring);
+
+  while (bz && batch && bzerr == BZ_OK) {
+    int n = BZ2_bzRead(&bzerr, bz, text + have, BZ2_CHUNK - have);
+    if (bzerr != BZ_OK && bzerr != BZ_STREAM_END) {
+      fprintf(stderr, "bzip2 decode error %d\n", bzerr);
+      break;
+    }
+    have += n;
+
+    // Concatenated streams (e.g. from pbzip2) continue with
+    // whatever the finished stream read past its end
+    if (bzerr == BZ_STREAM_END) {
+      void *unused;
+      int nunused;
+      char rest[BZ_MAX_UNUSED];
+      BZ2_bzReadGetUnused(&bzerr, bz, &unused, &nunused);
+      memcpy(rest, unused, nunused);
+      BZ2_bzReadClose(&bzerr, bz);
+      bz = NULL;
+      if (nunused > 0 || !feof(t->stream)) {
+        bz = BZ2_bzReadOpen(&bzerr, t->stream, 0, 0, rest, nunused);
+        if (bzerr != BZ_OK) {
+          // trailing garbage after the last stream
+          BZ2_bzReadClose(&bzerr, bz);
+          bz = NULL;
+        }
+      }
+      if (!bz && have > 0 && text[have - 1] != '\n') {
+        text[have++] = '\n';
+      }
+    }
+
+    // Parse every complete line, keeping the partial tail
+    char *p = text;
+    char *end = text + have;
+    while (batch) {
+      p += parse_text_block(p, end - p, batch);
+      if (batch->n < TRACE_BATCH) {
+        break;
+      }
+      ring_publish(ring);
+      batch = ring_claim(ring);
+    }
+    have = end - p;
+    memmove(text, p, have);
+    if (have == BZ2_CHUNK) {
+      fprintf(stderr, "Trace line longer than %d bytes\n", BZ2_CHUNK);
+      break;
+    }
+  }
+
+  if (batch && batch->n > 0) {
+    ring_publish(ring);
+  }
+  if (bz) {
+    BZ2_bzReadClose(&bzerr, bz);
+  }
+  free(text);
+  __atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static int
+start_bz2_decoder(trace_reader *t)
+{
+  t->format = TRACE_BZ2;
+  t->ring = (trace_ring*)calloc(1, sizeof(trace_ring));
+  if (pthread_create(&t->decoder, NULL, bz2_decoder, t) != 0) {
+    fprintf(stderr, "Unable to start the bzip2 decoder thread\n");
+    free(t->ring);
+    t->ring = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+// Release the drained slot and wait for the next one
+//
+// Returns False once the decoder has published everything
+//
+static int
+next_ring_batch(trace_reader *t)
+{
+  trace_ring *ring = t->ring;
+  if (t->batch) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    t->batch = NULL;
+  }
+  if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+    uint64_t start = stats_ticks();
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+      if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      ring_wait();
+    }
+    t->wait_ticks += stats_ticks() - start;
+
+    // the last publish happens before done is set
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+      return 0;
+    }
+  }
+  t->batch = &ring->slot[ring->tail & (TRACE_RING_SLOTS - 1)];
+  t->batch_pos = 0;
+  return 1;
+}
+
+// Decode the next batch of a columnar trace
+//
+// Returns False at the end of the trace
+//
+static int
+next_col_batch(trace_reader *t)
+{
+  if (!t->parsed) {
+    t->parsed = (trace_batch*)malloc(sizeof(trace_batch));
+  }
+  t->batch = t->parsed;
+  t->batch_pos = 0;
+  return col_decode(t->col, t->parsed) > 0;
+}
+
+// Decode the records of a live binary feed that have arrived,
+// waiting only while none have
+//
+// Returns False at the end of the feed
+//
+static int
+next_record_batch(trace_reader *t)
+{
+  trace_batch *batch = t->parsed;
+  size_t have = t->text_len - t->text_pos;
+
+  // Keep a partial record and read on
+  while (have < TRACE_RECORD_SIZE) {
+    memmove(t->text, t->text + t->text_pos, have);
+    t->text_pos = 0;
+    size_t n = read_input(t, t->text + have, TRACE_TEXT_BLOCK - have);
+    if (n == 0) {
+      t->text_len = have;
+      batch->n = 0;
+      return 0;
+    }
+    have += n;
+    t->text_len = have;
+  }
+
+  int n = have / TRACE_RECORD_SIZE < TRACE_BATCH ? (int)(have / TRACE_RECORD_SIZE) : TRACE_BATCH;
+  const uint8_t *rec = (const uint8_t*)t->text + t->text_pos;
+  for (int i = 0; i < n; i++, rec += TRACE_RECORD_SIZE) {
+    memcpy(&batch->pc[i], rec, sizeof(uint32_t));
+    batch->outcome[i] = rec[4];
+  }
+  t->text_pos += (size_t)n * TRACE_RECORD_SIZE;
+  batch->n = n;
+  t->batch = batch;
+  t->batch_pos = 0;
+  return 1;
+}
+
+// Make the next batch of parsed branches current
+//
+// Returns False at the end of the trace
+//
+static int
+next_batch(trace_reader *t)
+{
+  switch (t->format) {
+    case TRACE_BZ2:
+      return next_ring_batch(t);
+    case TRACE_COLUMNAR:
+      return next_col_batch(t);
+    case TRACE_RECORDS:
+      return next_record_batch(t);
+    default:
+      return next_text_batch(t);
+  }
+}
+
+//------------------------------------//
+//          Reader Interface          //
+//------------------------------------//
+
+int
+trace_open(trace_reader *t, const char *path)
+{
+  memset(t, 0, sizeof(*t));
+  t->format = TRACE_TEXT;
+
+  if (path) {
+    t->stream = fopen(path, "r");
+    if (!t->stream) {
+      perror(path);
+      return 0;
+    }
+  } else {
+    t->stream = stdin;
+  }
+
+  // Regular files are mapped whole; if the mapping does not
+  // start with a binary header it is dropped and the file is
+  // read as text through the (still unread) stream
+  struct stat st;
+  int fd = fileno(t->stream);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if (st.st_size < TRACE_HEADER_SIZE) {
+      return 1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      return 1;
+    }
+    if (col_is_header((const uint8_t*)map, st.st_size)) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      t->map = map;
+      t->map_len = st.st_size;
+      return attach_columns(t, (const uint8_t*)map, st.st_size);
+    }
+    if (!is_binary_header((const uint8_t*)map, st.st_size)) {
+      int compressed = !memcmp(map, BZ2_MAGIC, 3);
+      munmap(map, st.st_size);
+      return compressed ? start_bz2_decoder(t) : 1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    t->map = map;
+    t->map_len = st.st_size;
+    return attach_records(t, (const uint8_t*)map, st.st_size);
+  }
+
+  // Pipes: text traces always start with "0x", so one byte
+  // of lookahead separates text from the binary, columnar and
+  // bzip2 headers, which all start with 'B' and are told apart
+  // by the bytes that follow
+  int c = getc(t->stream);
+  if (c == EOF) {
+    return 1;
+  }
+  if (c != TRACE_MAGIC[0]) {
+    ungetc(c, t->stream);
+    return 1;
+  }
+  t->prefix[0] = c;
+  t->prefix_len = 1 + fread(t->prefix + 1, 1, sizeof(t->prefix) - 1, t->stream);
+  if (t->prefix_len >= 3 && !memcmp(t->prefix, BZ2_MAGIC, 3)) {
+    return start_bz2_decoder(t);
+  }
+  return read_binary_stream(t);
+}
+
+int
+trace_open_live(trace_reader *t, int fd, int (*wait)(void *arg, int fd), void *arg)
+{
+  memset(t, 0, sizeof(*t));
+  t->format = TRACE_TEXT;
+  t->live = 1;
+  t->fd = fd;
+  t->wait = wait;
+  t->wait_arg = arg;
+  t->text = (char*)calloc(TRACE_TEXT_BLOCK + 1 + TRACE_TEXT_PAD, 1);
+  t->parsed = (trace_batch*)malloc(sizeof(trace_batch));
+
+  // Text starts with "0x" and binary with a header, whose
+  // bytes have to be in before anything can be decided
+  while (t->text_len == 0 || (t->text[0] == TRACE_MAGIC[0] && t->text_len < TRACE_HEADER_SIZE)) {
+    size_t n = read_input(t, t->text + t->text_len, TRACE_TEXT_BLOCK - t->text_len);
+    if (n == 0) {
+      break;
+    }
+    t->text_len += n;
+  }
+  if (t->text_len == 0 || t->text[0] != TRACE_MAGIC[0]) {
+    // an empty feed reads as an empty trace
+    t->text_eof = t->text_len == 0;
+    return 1;
+  }
+  if (!is_binary_header((const uint8_t*)t->text, t->text_len)) {
+    fprintf(stderr, "Live feeds take text or binary records, not this header\n");
+    return 0;
+  }
+  t->format = TRACE_RECORDS;
+  t->text_pos = TRACE_HEADER_SIZE;
+  return 1;
+}
+
+int
+trace_read(trace_reader *t, uint32_t *pc, uint8_t *outcome)
+{
+  if (t->format == TRACE_BINARY) {
+    if (t->pos >= t->count) {
+      return 0;
+    }
+    const uint8_t *rec = t->records + t->pos * TRACE_RECORD_SIZE;
+    memcpy(pc, rec, sizeof(uint32_t));
+    *outcome = rec[4];
+    t->pos++;
+    return 1;
+  }
+
+  // text, bzip2 and columnar are all drained from parsed batches
+  if (!t->batch || t->batch_pos >= t->batch->n) {
+    if (!next_batch(t)) {
+      return 0;
+    }
+  }
+  *pc = t->batch->pc[t->batch_pos];
+  *outcome = t->batch->outcome[t->batch_pos];
+  t->batch_pos++;
+  return 1;
+}
+
+int
+trace_read_batch(trace_reader *t, trace_batch *batch)
+{
+  int n = 0;
+
+  if (t->format == TRACE_BINARY) {
+    uint64_t left = t->count - t->pos;
+    n = left < TRACE_BATCH ? (int)left : TRACE_BATCH;
+    const uint8_t *rec = t->records + t->pos * TRACE_RECORD_SIZE;
+    for (int i = 0; i < n; i++, rec += TRACE_RECORD_SIZE) {
+      memcpy(&batch->pc[i], rec, sizeof(uint32_t));
+      batch->outcome[i] = rec[4];
+    }
+    t->pos += n;
+  } else {
+    if (!t->batch || t->batch_pos >= t->batch->n) {
+      if (!next_batch(t)) {
+        batch->n = 0;
+        return 0;
+      }
+    }
+    n = t->batch->n - t->batch_pos;
+    memcpy(batch->pc, t->batch->pc + t->batch_pos, n * sizeof(uint32_t));
+    memcpy(batch->outcome, t->batch->outcome + t->batch_pos, n);
+    t->batch_pos += n;
+  }
+
+  batch->n = n;
+  return n;
+}
+
+uint64_t
+trace_skip(trace_reader *t, uint64_t n)
+{
+  uint64_t skipped = 0;
+
+  if (t->format == TRACE_BINARY) {
+    skipped = n < t->count - t->pos ? n : t->count - t->pos;
+    t->pos += skipped;
+    return skipped;
+  }
+
+  // the others drop whole parsed batches
+  while (skipped < n) {
+    if (!t->batch || t->batch_pos >= t->batch->n) {
+      if (!next_batch(t)) {
+        break;
+      }
+    }
+    uint64_t left = t->batch->n - t->batch_pos;
+    uint64_t take = left < n - skipped ? left : n - skipped;
+    t->batch_pos += take;
+    skipped += take;
+  }
+  return skipped;
+}
+
+void
+trace_close(trace_reader *t)
+{
+  if (t->ring) {
+    __atomic_store_n(&t->ring->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(t->decoder, NULL);
+    free(t->ring);
+  }
+  col_close(t->col);
+  if (t->map) {
+    if (t->map_len) {
+      munmap(t->map, t->map_len);
+    } else {
+      free(t->map);
+    }
+  }
+  if (t->stream && t->stream != stdin) {
+    fclose(t->stream);
+  }
+  if (t->live) {
+    close(t->fd);
+  }
+  free(t->text);
+  free(t->parsed);
+  memset(t, 0, sizeof(*t));
+}
+
+int
+trace_load(const char *path, trace_data *d)
+{
+  trace_reader t;
+  trace_batch *batch;
+  uint64_t cap;
+
+  memset(d, 0, sizeof(*d));
+  if (!trace_open(&t, path)) {
+    return 0;
+  }
+
+  // Binary and columnar traces know their length up front
+  cap = t.format == TRACE_BINARY || t.format == TRACE_COLUMNAR ? t.count : (1 << 20);
+  if (cap == 0) {
+    cap = 1;
+  }
+  d->pc = (uint32_t*)malloc(cap * sizeof(uint32_t));
+  d->outcome = (uint8_t*)malloc(cap);
+
+  batch = (trace_batch*)malloc(sizeof(trace_batch));
+  while (trace_read_batch(&t, batch) > 0) {
+    if (d->count + batch->n > cap) {
+      while (d->count + batch->n > cap) {
+        cap *= 2;
+      }
+      d->pc = (uint32_t*)realloc(d->pc, cap * sizeof(uint32_t));
+      d->outcome = (uint8_t*)realloc(d->outcome, cap);
+    }
+    memcpy(d->pc + d->count, batch->pc, batch->n * sizeof(uint32_t));
+    memcpy(d->outcome + d->count, batch->outcome, batch->n);
+    d->count += batch->n;
+  }
+
+  free(batch);
+  trace_close(&t);
+  return 1;
+}
+
+void
+trace_free(trace_data *d)
+{
+  free(d->pc);
+  free(d->outcome);
+  memset(d, 0, sizeof(*d));
+}
+
+int64_t
+trace_convert(trace_reader *t, const char *path)
+{
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return -1;
+  }
+
+  // The count is patched in once the whole input has been read
+  trace_header hdr;
+  memcpy(hdr.magic, TRACE_MAGIC, 4);
+  hdr.version = TRACE_VERSION;
+  hdr.count = 0;
+  fwrite(&hdr, TRACE_HEADER_SIZE, 1, out);
+
+  uint8_t rec[TRACE_RECORD_SIZE];
+  uint32_t pc;
+  uint8_t outcome;
+  while (trace_read(t, &pc, &outcome)) {
+    memcpy(rec, &pc, sizeof(uint32_t));
+    rec[4] = outcome;
+    fwrite(rec, TRACE_RECORD_SIZE, 1, out);
+    hdr.count++;
+  }
+
+  fseek(out, 0, SEEK_SET);
+  fwrite(&hdr, TRACE_HEADER_SIZE, 1, out);
+  if (fclose(out) != 0) {
+    perror(path);
+    return -1;
+  }
+
+  return hdr.count;
+}
+
+int64_t
+trace_convert_columnar(trace_reader *t, const char *path)
+{
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return -1;
+  }
+
+  // The columns are built in memory and written once complete
+  int64_t count = col_encode(t, out);
+  if (fclose(out) != 0 || count < 0) {
+    perror(path);
+    return -1;
+  }
+
+  return count;
+}
@@ -0,0 +1,214 @@
+//========================================================//
+//  trace.h                                               //
+//  Header file for the branch trace readers              //
+//                                                        //
+//  A trace is either the original text format            //
+//  ("0x<pc> <outcome>" per line), that text compressed   //
+//  with bzip2, or one of the binary formats below        //
+//========================================================//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+//------------------------------------//
+//        Binary Trace Format         //
+//------------------------------------//
+//
+// A 16 byte header followed by 'count' fixed-width records.
+// Each record is the 32 bit PC (little endian) followed by
+// one outcome byte, with no padding between records.
+//
+#define TRACE_MAGIC        "BPTR"
+#define TRACE_VERSION      1
+#define TRACE_HEADER_SIZE  16
+#define TRACE_RECORD_SIZE  5
+
+typedef struct trace_header {
+  char magic[4];    // TRACE_MAGIC
+  uint32_t version; // TRACE_VERSION
+  uint64_t count;   // number of records that follow
+} trace_header;
+
+//------------------------------------//
+//       Columnar Trace Format        //
+//------------------------------------//
+//
+// A 40 byte header followed by three columns (see column.h):
+//   the PC dictionary, every distinct PC in order of first
+//   appearance as zigzag varint deltas; the PC index column and
+//   the outcome column, each range coded on its own
+//
+#define TRACE_COL_MAGIC        "BPTC"
+#define TRACE_COL_VERSION      1
+#define TRACE_COL_HEADER_SIZE  40
+
+typedef struct trace_col_header {
+  char magic[4];          // TRACE_COL_MAGIC
+  uint32_t version;       // TRACE_COL_VERSION
+  uint64_t count;         // number of branches
+  uint32_t pcs;           // dictionary entries
+  uint32_t dict_size;     // bytes of each column, in file order
+  uint64_t index_size;
+  uint64_t outcome_size;
+} trace_col_header;
+
+// Formats a reader can detect
+#define TRACE_TEXT      0
+#define TRACE_BINARY    1
+#define TRACE_BZ2       2
+#define TRACE_COLUMNAR  3
+#define TRACE_RECORDS   4  // binary records arriving on a live feed
+
+#define BZ2_MAGIC     "BZh"
+
+//------------------------------------//
+//        Decoded Branch Batches      //
+//------------------------------------//
+//
+// bzip2 traces are decompressed and parsed on a separate
+// decoder thread, which hands batches of branches to the
+// simulation through a single-producer/single-consumer ring
+//
+#define TRACE_BATCH       4096
+#define TRACE_RING_SLOTS  8   // must be a power of 2
+
+// Text is parsed from blocks of TRACE_TEXT_BLOCK bytes; the
+// parser may read up to TRACE_TEXT_PAD bytes past the end
+#define TRACE_TEXT_BLOCK  (1 << 20)
+#define TRACE_TEXT_PAD    64
+
+typedef struct trace_batch {
+  uint32_t pc[TRACE_BATCH];
+  uint8_t outcome[TRACE_BATCH];
+  int n;
+} trace_batch;
+
+typedef struct trace_ring {
+  trace_batch slot[TRACE_RING_SLOTS];
+  unsigned head;  // next slot the decoder fills, only it writes this
+  unsigned tail;  // next slot the reader drains, only it writes this
+  int done;       // set by the decoder after its last batch
+  int stop;       // set by the reader to abandon decoding early
+} trace_ring;
+
+// A whole trace decoded into memory, shared read-only by
+// any number of simulations
+typedef struct trace_data {
+  uint32_t *pc;
+  uint8_t *outcome;
+  uint64_t count;
+} trace_data;
+
+// Decoder state of a columnar trace (see column.h)
+typedef struct trace_col trace_col;
+
+//------------------------------------//
+//            Trace Reader            //
+//------------------------------------//
+
+typedef struct trace_reader {
+  int format;
+
+  // text input, read in blocks and parsed a batch at a time
+  FILE *stream;
+  char *text;
+  size_t text_len;
+  size_t text_pos;
+  int text_eof;
+  trace_batch *parsed;
+
+  // live feeds, read as data arrives (see trace_open_live)
+  int live;
+  int fd;
+  int (*wait)(void *arg, int fd);
+  void *wait_arg;
+
+  // binary and columnar input, either mmapped or read into memory
+  const uint8_t *records;
+  uint64_t count;
+  uint64_t pos;
+  void *map;
+  size_t map_len;
+  trace_col *col;
+
+  // bzip2 input
+  trace_ring *ring;
+  pthread_t decoder;
+  trace_batch *batch;  // ring slot or parsed text currently being drained
+  int batch_pos;
+  uint8_t prefix[4];   // header bytes consumed while sniffing a pipe
+  int prefix_len;
+  uint64_t wait_ticks; // time spent waiting for the decoder (see stats.h)
+} trace_reader;
+
+// Open the trace at 'path' (stdin if NULL) and detect its format
+//
+// Returns True if Successful
+//
+int trace_open(trace_reader *t, const char *path);
+
+// Attach the reader to a live feed on 'fd' (a FIFO or a
+// connected socket), which it closes on trace_close. The feed
+// is text or a binary header followed by records for as long
+// as the writer keeps sending; the header's count is ignored.
+// Branches are handed out as soon as they arrive, and the
+// reader holds one block of input however long the feed runs.
+// Unless 'wait' is NULL, each read first waits in
+// 'wait(arg, fd)' for input, and the feed ends like it does
+// at EOF when that returns False
+//
+// Returns True if Successful
+//
+int trace_open_live(trace_reader *t, int fd, int (*wait)(void *arg, int fd), void *arg);
+
+// Read the next branch from the trace
+//
+// Returns True if Successful, False at the end of the trace
+//
+int trace_read(trace_reader *t, uint32_t *pc, uint8_t *outcome);
+
+// Read up to TRACE_BATCH branches from the trace into 'batch'
+//
+// Returns the number of branches read, 0 at the end of the trace
+//
+int trace_read_batch(trace_reader *t, trace_batch *batch);
+
+// Skip up to 'n' branches without decoding them where the
+// format allows (binary traces skip in constant time)
+//
+// Returns the number of branches skipped
+//
+uint64_t trace_skip(trace_reader *t, uint64_t n);
+
+// Release everything held by the reader
+//
+void trace_close(trace_reader *t);
+
+// Decode the whole trace at 'path' (stdin if NULL) into 'd'
+//
+// Returns True if Successful
+//
+int trace_load(const char *path, trace_data *d);
+
+// Free a trace decoded by trace_load
+//
+void trace_free(trace_data *d);
+
+// Write the remainder of 't' to 'path' in the binary format
+//
+// Returns the number of records written, or -1 on error
+//
+int64_t trace_convert(trace_reader *t, const char *path);
+
+// Write the remainder of 't' to 'path' in the columnar format
+//
+// Returns the number of branches written, or -1 on error
+//
+int64_t trace_convert_columnar(trace_reader *t, const char *path);
+
+#endif
@@ -0,0 +1,156 @@
+//========================================================//
+//  window.c                                              //
+//  Source file for windowed statistics and phases        //
+//========================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "window.h"
+
+int
+window_open(window_series *w, uint64_t size, double threshold, const char *path)
+{
+  memset(w, 0, sizeof(*w));
+  w->out = fopen(path, "w");
+  if (!w->out) {
+    perror(path);
+    return 0;
+  }
+  w->size = size;
+  w->threshold = threshold;
+  w->mask = WINDOW_INITIAL_PCS - 1;
+  w->pcs = (window_pc*)calloc(WINDOW_INITIAL_PCS, sizeof(window_pc));
+  w->epoch = 1;
+  w->phase = -1;
+  fprintf(w->out, "window,first,branches,mispredictions,rate,unique_pcs,taken_ratio,"
+                  "phase,distance,change\n");
+  return 1;
+}
+
+void
+window_grow(window_series *w)
+{
+  uint32_t size = (w->mask + 1) * 2;
+  window_pc *pcs = (window_pc*)calloc(size, sizeof(window_pc));
+
+  // Entries of earlier windows are left behind
+  for (uint32_t i = 0; i <= w->mask; i++) {
+    if (w->pcs[i].epoch == w->epoch) {
+      uint32_t j = window_hash(w->pcs[i].pc) & (size - 1);
+      while (pcs[j].epoch) {
+        j = (j + 1) & (size - 1);
+      }
+      pcs[j] = w->pcs[i];
+    }
+  }
+
+  free(w->pcs);
+  w->pcs = pcs;
+  w->mask = size - 1;
+}
+
+void
+window_add(window_series *w, const uint32_t *pc, const uint8_t *outcome,
+           int n, uint32_t mispredictions)
+{
+  for (int i = 0; i < n; i++) {
+    window_count(w, pc[i], outcome[i]);
+  }
+  w->mispredictions += mispredictions;
+  if (w->branches == w->size) {
+    window_flush(w);
+  }
+}
+
+// Match the window's signature 'v' to the nearest known phase,
+// or start a new one if none is within the threshold
+//
+// Returns the phase, and its distance from 'v' in 'distance'
+//
+static int
+classify(window_series *w, const double *v, double *distance)
+{
+  int nearest = -1;
+  double best = 0;
+  for (int p = 0; p < w->phases; p++) {
+    double d = 0;
+    for (int b = 0; b < WINDOW_SIGNATURE; b++) {
+      d += fabs(v[b] - w->centroid[p][b]);
+    }
+    if (nearest < 0 || d < best) {
+      nearest = p;
+      best = d;
+    }
+  }
+
+  // Once the phase table is full, windows join the nearest
+  if ((nearest < 0 || best > w->threshold) && w->phases < WINDOW_MAX_PHASES) {
+    nearest = w->phases++;
+    best = 0;
+  }
+
+  // The centroid is the running mean of the phase's windows
+  uint64_t n = ++w->phase_windows[nearest];
+  for (int b = 0; b < WINDOW_SIGNATURE; b++) {
+    w->centroid[nearest][b] += (v[b] - w->centroid[nearest][b]) / n;
+  }
+  *distance = best;
+  return nearest;
+}
+
+void
+window_flush(window_series *w)
+{
+  if (w->branches == 0) {
+    return;
+  }
+
+  double v[WINDOW_SIGNATURE];
+  for (int b = 0; b < WINDOW_SIGNATURE; b++) {
+    v[b] = (double)w->signature[b] / w->branches;
+  }
+  double distance;
+  int phase = classify(w, v, &distance);
+  int change = w->phase >= 0 && phase != w->phase;
+  w->changes += change;
+  w->phase = phase;
+
+  fprintf(w->out, "%llu,%llu,%llu,%llu,%.3f,%u,%.4f,%d,%.4f,%d\n",
+          (unsigned long long)(w->first / w->size), (unsigned long long)w->first,
+          (unsigned long long)w->branches, (unsigned long long)w->mispredictions,
+          100.0 * w->mispredictions / w->branches, w->unique,
+          (double)w->taken / w->branches, phase, distance, change);
+
+  w->first += w->branches;
+  w->branches = 0;
+  w->mispredictions = 0;
+  w->taken = 0;
+  memset(w->signature, 0, sizeof(w->signature));
+  w->unique = 0;
+  w->epoch++;
+}
+
+int
+window_close(window_series *w)
+{
+  window_flush(w);
+  free(w->pcs);
+  w->pcs = NULL;
+  int ok = !ferror(w->out);
+  ok = fclose(w->out) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Error writing the window statistics\n");
+  }
+  return ok;
+}
+
+void
+window_report(const window_series *w, FILE *out)
+{
+  uint64_t windows = (w->first + w->size - 1) / w->size;
+  fprintf(out, "Windows:         %10llu of %llu branches\n",
+          (unsigned long long)windows, (unsigned long long)w->size);
+  fprintf(out, "Phases:          %10d, %llu changes\n", w->phases,
+          (unsigned long long)w->changes);
+}
@@ -0,0 +1,137 @@
+//========================================================//
+//  window.h                                              //
+//  Header file for windowed statistics and phases        //
+//                                                        //
+//  Every window of N branches becomes one CSV row with   //
+//  its mispredictions, distinct PCs and taken ratio. A   //
+//  window's code signature (branches per PC hash bucket, //
+//  as a fraction of the window) is matched against the   //
+//  phases seen so far, so recurring program phases get   //
+//  the same number and a change of phase is flagged      //
+//========================================================//
+
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define WINDOW_SIGNATURE_BITS     5
+#define WINDOW_SIGNATURE          (1 << WINDOW_SIGNATURE_BITS)  // hash buckets
+#define WINDOW_MAX_PHASES         64
+#define WINDOW_DEFAULT_THRESHOLD  0.5   // signature distance (0 - 2) that starts a new phase
+#define WINDOW_INITIAL_PCS        4096  // distinct PC set slots, power of 2
+
+typedef struct window_pc {
+  uint32_t pc;
+  uint32_t epoch;   // number of the window that set it, 0: empty
+} window_pc;
+
+typedef struct window_series {
+  FILE *out;
+  uint64_t size;    // branches per window
+  double threshold;
+
+  // The window being filled
+  uint64_t first;   // number of its first branch
+  uint64_t branches;
+  uint64_t mispredictions;
+  uint64_t taken;
+  uint32_t signature[WINDOW_SIGNATURE];
+  window_pc *pcs;   // distinct PCs, cleared by bumping the epoch
+  uint32_t mask;
+  uint32_t unique;
+  uint32_t epoch;
+
+  // Phases seen so far, by the mean signature of their windows
+  double centroid[WINDOW_MAX_PHASES][WINDOW_SIGNATURE];
+  uint64_t phase_windows[WINDOW_MAX_PHASES];
+  int phases;
+  int phase;        // of the last window, -1 before the first
+  uint64_t changes;
+} window_series;
+
+// Start a series of 'size' branch windows written as CSV to
+// 'path', matching signatures within 'threshold' to a known
+// phase
+//
+// Returns True if Successful
+//
+int window_open(window_series *w, uint64_t size, double threshold, const char *path);
+
+// Double the distinct PC set once it is half full
+//
+void window_grow(window_series *w);
+
+// Classify the window, write its row and start the next one
+//
+void window_flush(window_series *w);
+
+static inline uint32_t
+window_hash(uint32_t pc)
+{
+  uint32_t h = pc * 0x9E3779B1u;
+  return h ^ (h >> 16);
+}
+
+// Count one branch, without its prediction, into the window
+//
+static inline void
+window_count(window_series *w, uint32_t pc, uint8_t outcome)
+{
+  uint32_t h = window_hash(pc);
+  w->branches++;
+  w->taken += outcome;
+  w->signature[h >> (32 - WINDOW_SIGNATURE_BITS)]++;
+
+  uint32_t i = h & w->mask;
+  while (w->pcs[i].epoch == w->epoch && w->pcs[i].pc != pc) {
+    i = (i + 1) & w->mask;
+  }
+  if (w->pcs[i].epoch != w->epoch) {
+    w->pcs[i].pc = pc;
+    w->pcs[i].epoch = w->epoch;
+    if (++w->unique * 2 > w->mask + 1) {
+      window_grow(w);
+    }
+  }
+}
+
+// Record one branch and the prediction made for it
+//
+static inline void
+window_record(window_series *w, uint32_t pc, uint8_t outcome, uint8_t prediction)
+{
+  window_count(w, pc, outcome);
+  w->mispredictions += outcome != prediction;
+  if (w->branches == w->size) {
+    window_flush(w);
+  }
+}
+
+// Returns how many of the next 'n' branches fit in the window
+//
+static inline int
+window_room(const window_series *w, int n)
+{
+  uint64_t room = w->size - w->branches;
+  return room < (uint64_t)n ? (int)room : n;
+}
+
+// Record 'n' branches, at most window_room of them, that were
+// simulated as a batch with 'mispredictions' between them
+//
+void window_add(window_series *w, const uint32_t *pc, const uint8_t *outcome,
+                int n, uint32_t mispredictions);
+
+// Write out the last, partial window and close the stream
+//
+// Returns True if Successful
+//
+int window_close(window_series *w);
+
+// Print the number of windows, phases and phase changes
+//
+void window_report(const window_series *w, FILE *out);
+
+#endif